@@ -19,7 +19,7 @@ using namespace std;
 // - lumps to which it is connected (later, upgrade this to a full Connection object)
 // - notes on the lump's strategic importance
 // - Its status (alive, unsettled, dead, unknown)
-// The LumpData objects are stored in a map lump_data indexed by Lump pointer
+// The LumpData objects are stored in a map lump_data indexed by lump id
 
 // Each team is stored as a TeamData object, which contains
 // - a list of lumps involved
@@ -57,10 +57,17 @@ int TLGETC::get_move()
 void TLGETC::make_move(int pos)
 {
 	assert(b.is_legal_move(pos));
-	ReadingLog log;
+	ReadingLog log(board_size);
 	ReadingSettings settings;
+	settings.node_budget=read_node_budget;
+	settings.solver=read_solver;
+	settings.lambda_order=lambda_order;
+	settings.threads=read_threads;
+	log.set_time_limit(move_time_ms);
 
 	cout<< "TLGETC - Updating board state...\n";
+	// Hash entries from earlier moves are now the first to go when the table fills up
+	hash.new_generation();
 
 	// Deal with pass separately
 	if(pos==-1)
@@ -70,12 +77,12 @@ void TLGETC::make_move(int pos)
 	}
 
 	// Create list of adjacent lumps that need updating
-	vector<Lump*> to_be_captured;
-	vector<Lump*> to_be_merged;
+	vector<int> to_be_captured;
+	vector<int> to_be_merged;
 	b.adj_lumps_captured(pos, HV, b.not_to_move(), to_be_captured);
 	b.adj_lumps(pos, HV, b.to_move, to_be_merged);
 
-	// IMPORTANT - to_be_merged contains pointers to lumps that don't exist. Any data referring to these has to be updated
+	// IMPORTANT - to_be_merged contains ids of lumps that don't exist. Any data referring to these has to be updated
 	// (or, more likely, recalculated, since the lump at pos is interesting)
 
 	// Make a list of interesting lumps (those that need updating).
@@ -87,20 +94,20 @@ void TLGETC::make_move(int pos)
 	// Anything within a certain distance of the new move (taxicab radius of 3 or 4).
 
 	interesting_lumps.clear();
-	for(vector<Lump*>::iterator ii = to_be_captured.begin();ii!=to_be_captured.end();ii++)
+	for(vector<int>::iterator ii = to_be_captured.begin();ii!=to_be_captured.end();ii++)
 	{
-		vector<Lump*> store; // lumps adjacent to this captured one.
+		vector<int> store; // lumps adjacent to this captured one.
 		store.clear();
 		b.lump_adj_lumps(*ii, HV, b.to_move, store);
 		// Since they have new liberties, the status of their surrounding stones might change too.
-		for(vector<Lump*>::iterator jj = store.begin();jj!=store.end();jj++)
+		for(vector<int>::iterator jj = store.begin();jj!=store.end();jj++)
 		{
-			if((*jj)->liberties<=3) b.lump_adj_lumps(*jj, HV, b.not_to_move(), interesting_lumps);
+			if(b.lump_liberties[*jj]<=3) b.lump_adj_lumps(*jj, HV, b.not_to_move(), interesting_lumps);
 		}
 		interesting_lumps.insert(interesting_lumps.end(), store.begin(), store.end());
 	}
 	// Remove to_be_captured and to_be_merged from interesting_lumps
-	for(vector<Lump*>::iterator ii = interesting_lumps.begin();ii!=interesting_lumps.end();)
+	for(vector<int>::iterator ii = interesting_lumps.begin();ii!=interesting_lumps.end();)
 	{
 		if(find(to_be_merged.begin(), to_be_merged.end(), *ii)!=to_be_merged.end() 
 			|| find(to_be_captured.begin(), to_be_captured.end(), *ii)!=to_be_captured.end())
@@ -111,14 +118,16 @@ void TLGETC::make_move(int pos)
 	// Play move
 	b.play_move(pos);
 	interesting_lumps.push_back(b.board[pos]);
+	b.move_features(BLACK, features[BLACK]);
+	b.move_features(WHITE, features[WHITE]);
 
 	// Lumps adjacent to new lump
-	vector<Lump*> store2;
+	vector<int> store2;
 	store2.clear();
 	b.lump_adj_lumps(b.board[pos], HV, b.to_move, store2);
-	for(vector<Lump*>::iterator jj = store2.begin();jj!=store2.end();jj++)
+	for(vector<int>::iterator jj = store2.begin();jj!=store2.end();jj++)
 	{ // Add this lump, and if it is now low on liberties, add its neighbours too.
-		if((*jj)->liberties<=3) b.lump_adj_lumps(*jj, HV, b.to_move, interesting_lumps);
+		if(b.lump_liberties[*jj]<=3) b.lump_adj_lumps(*jj, HV, b.to_move, interesting_lumps);
 		interesting_lumps.push_back(*jj);
 	}
 	// Lumps in a taxicab radius of 3
@@ -129,20 +138,31 @@ void TLGETC::make_move(int pos)
 
 	cout<<"TLGETC - Updating lump data...\n";
 	
-	//Add lump_data entry for new stone
-	LumpData x(pos, b.board_size);
-	lump_data.insert(make_pair(b.board[pos], x));
+	//Add lump_data entry for new stone. If it joined a friendly lump, that lump kept its id (and its
+	//data), so just stretch its bounds to take in pos.
+	map<int, LumpData>::iterator new_data=lump_data.find(b.board[pos]);
+	if(new_data==lump_data.end())
+	{
+		LumpData x(pos, b.board_size);
+		lump_data.insert(make_pair(b.board[pos], x));
+	} else {
+		new_data->second.left = min(new_data->second.left, pos%b.board_size);
+		new_data->second.right = max(new_data->second.right, pos%b.board_size);
+		new_data->second.top = min(new_data->second.top, (int)(pos/b.board_size));
+		new_data->second.bottom = max(new_data->second.bottom, (int)(pos/b.board_size));
+	}
 	// Now erase lump data of captured stones
-	for(vector<Lump*>::iterator ii = to_be_captured.begin(); ii!=to_be_captured.end();ii++)
+	for(vector<int>::iterator ii = to_be_captured.begin(); ii!=to_be_captured.end();ii++)
 	{
 		lump_data.erase(*ii);
 	}
 	// Anything in to_be_merged not equal to the lump at pos must have been merged,
 	// so we merge its data.
-	for(vector<Lump*>::iterator ii = to_be_merged.begin(); ii!=to_be_merged.end();ii++)
+	for(vector<int>::iterator ii = to_be_merged.begin(); ii!=to_be_merged.end();ii++)
 	{
-		map<Lump*, LumpData>::iterator i=lump_data.find(b.board[pos]);
-		map<Lump*, LumpData>::iterator j=lump_data.find(*ii);
+		if(*ii==b.board[pos]) continue;
+		map<int, LumpData>::iterator i=lump_data.find(b.board[pos]);
+		map<int, LumpData>::iterator j=lump_data.find(*ii);
 
 		assert(i!=lump_data.end());
 		i->second.left = min(i->second.left, j->second.left);
@@ -157,11 +177,11 @@ void TLGETC::make_move(int pos)
 	cout<<"TLGETC - Recalculating connections...\n";
 
 	// Create list of all lumps
-	vector<Lump*> lump_list;
+	vector<int> lump_list;
 	lump_list.clear();
 	b.all_lumps(lump_list);
 	// Clear all old connection data involving interesting lumps
-	for(vector<Lump*>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
+	for(vector<int>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
 	{
 		if(find(interesting_lumps.begin(), interesting_lumps.end(), *ii)!=interesting_lumps.end()) 
 		{
@@ -169,7 +189,7 @@ void TLGETC::make_move(int pos)
 		}
 		else
 		{
-			for(vector<Lump*>::iterator jj = lump_data[*ii].connections.begin();jj!=lump_data[*ii].connections.end();)
+			for(vector<int>::iterator jj = lump_data[*ii].connections.begin();jj!=lump_data[*ii].connections.end();)
 			{
 				if(find(interesting_lumps.begin(), interesting_lumps.end(), *jj)!=interesting_lumps.end()
 					|| find(to_be_merged.begin(), to_be_merged.end(), *jj)!=to_be_merged.end()) 
@@ -183,12 +203,12 @@ void TLGETC::make_move(int pos)
 	}
 
 	// Iterate through all pairs
-	for(vector<Lump*>::iterator ii = lump_list.begin();ii!=lump_list.end()-1;ii++){
-	for(vector<Lump*>::iterator jj = ii+1;jj!=lump_list.end();jj++)
+	for(vector<int>::iterator ii = lump_list.begin();ii!=lump_list.end()-1;ii++){
+	for(vector<int>::iterator jj = ii+1;jj!=lump_list.end();jj++)
 	{
 		// Call is_connected on each pair
 		// If true, add each lump to the other's list of connections in lump_data
-		if((*ii)->colour==(*jj)->colour 
+		if(b.lump_colour[*ii]==b.lump_colour[*jj] 
 			&& ((find(interesting_lumps.begin(), interesting_lumps.end(), *ii)!=interesting_lumps.end())
 				|| (find(interesting_lumps.begin(), interesting_lumps.end(), *jj)!=interesting_lumps.end()))
 			&& is_connected(*ii, *jj, settings, log))
@@ -210,16 +230,16 @@ void TLGETC::make_move(int pos)
 	teams.clear();
 
 	// ...and start over with new teams
-	for(vector<Lump*>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
+	for(vector<int>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
 	{
-		Team* t = new Team(*ii, lump_data);
+		Team* t = new Team(b, *ii, lump_data);
 		lump_data[*ii].team = t;
 		teams.push_back(t);
 	}
 
-	for(vector<Lump*>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
+	for(vector<int>::iterator ii = lump_list.begin();ii!=lump_list.end();ii++)
 	{
-		for(vector<Lump*>::iterator jj=lump_data[*ii].connections.begin(); jj!=lump_data[*ii].connections.end();jj++)
+		for(vector<int>::iterator jj=lump_data[*ii].connections.begin(); jj!=lump_data[*ii].connections.end();jj++)
 		{
 			Team* t1=lump_data.find(*ii)->second.team;
 			assert(lump_data.find(*jj)!=lump_data.end());
@@ -234,7 +254,7 @@ void TLGETC::make_move(int pos)
 				t1->size=t1->size + t2->size;
 
 				t1->lumps.insert(t1->lumps.end(), t2->lumps.begin(), t2->lumps.end());
-				for(vector<Lump*>::iterator kk = t2->lumps.begin();kk!=t2->lumps.end();kk++)
+				for(vector<int>::iterator kk = t2->lumps.begin();kk!=t2->lumps.end();kk++)
 				{
 					lump_data[*kk].team = t1;
 				}
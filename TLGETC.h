@@ -20,8 +20,8 @@ public:
 	int top;
 	int bottom;
 	int status; // (ALIVE, DEAD, UNSETTLED, or -1 for unknown)
-	// List of lumps connected to this one
-	std::vector<Lump*> connections;
+	// List of lumps connected to this one (lump ids)
+	std::vector<int> connections;
 
 	// Team containing this lump
 	Team* team;
@@ -33,14 +33,14 @@ public:
 		status=-1;
 	}
 	LumpData(void){}
-	std::string display(void)
+	std::string display(BoardState& b)
 	{
 		std::stringstream str;
 		str<< "L"<<left<<" R"<<right<<" T"<<top<<" B"<<bottom<<"\n";
 		str<<"Connected to "<<connections.size()<<" other lumps" <<(connections.size()>0 ? ": " : ".");
-		for(std::vector<Lump*>::iterator ii = connections.begin();ii!=connections.end();ii++)
+		for(std::vector<int>::iterator ii = connections.begin();ii!=connections.end();ii++)
 		{
-			str<<"("<<(*ii)->stones[0]%DEBUG_BS<<","<<(int)(*ii)->stones[0]/DEBUG_BS<< ") ";
+			str<<"("<<b.lump_stone[*ii]%b.board_size<<","<<(int)b.lump_stone[*ii]/b.board_size<< ") ";
 		}
 		str<<"\n";
 		return str.str();
@@ -64,17 +64,17 @@ class LDResult
 class Team
 {
 public:
-	Team(Lump* target, std::map<Lump*, LumpData>& lump_data)
+	Team(BoardState& board, int target, std::map<int, LumpData>& lump_data)
 	{
 		lumps.push_back(target);
 		l=lump_data[target].left;
 		r=lump_data[target].right;
 		t=lump_data[target].top;
 		b=lump_data[target].bottom;
-		size=target->size();
+		size=board.lump_size[target];
 	}
 
-	std::vector<Lump*> lumps;
+	std::vector<int> lumps;
 	int l;
 	int r;
 	int t;
@@ -88,14 +88,27 @@ class TLGETC: public Engine
 {
 public:
 	BoardState b;
-	std::map<Lump*, LumpData> lump_data;
+	std::map<int, LumpData> lump_data; // Indexed by lump id
 	ZobristHash hash;
 
-	std::vector<Lump*> interesting_lumps; // List of lumps affected by the most recent move
+	std::vector<int> interesting_lumps; // List of lumps affected by the most recent move
+
+	// Move features for each colour (indexed by BLACK/WHITE) in the current position.
+	// Filled in by make_move after each move, and read by is_connected.
+	MoveFeatures features[2];
 
 	std::vector<Team*> teams; // Keep a list of teams
 
-	TLGETC(int bsize): Engine(bsize), b(bsize), hash(bsize) // Creates engine with empty board b of size bsize
+	// Limits on the reading make_move does: nodes for each read, and milliseconds for the whole move
+	// (0 for no limit). With either set, reads deepen a step at a time and stop when the budget does
+	// (see read_status in reading.cpp).
+	int read_node_budget;
+	int move_time_ms;
+	int read_solver; // FIXED_DEPTH_SOLVER, DFPN_SOLVER or LAMBDA_SOLVER (see reading.h)
+	int lambda_order; // For LAMBDA_SOLVER
+	int read_threads; // Threads each read is shared between (see ReadingSettings::threads)
+
+	TLGETC(int bsize): Engine(bsize), b(bsize), hash(bsize), read_node_budget(0), move_time_ms(0), read_solver(FIXED_DEPTH_SOLVER), lambda_order(3), read_threads(1) // Creates engine with empty board b of size bsize
 	{
 		b.hash = &hash;
 	}
@@ -104,7 +117,7 @@ public:
 	std::string get_name(void){return "TLGETC v0.1";}
 
 	// Processing methods *usually defined in other source files* (not TLGETC.cpp)
-	bool is_connected(Lump* lump1, Lump* lump2, ReadingSettings settings, ReadingLog& log);
+	bool is_connected(int lump1, int lump2, ReadingSettings settings, ReadingLog& log);
 
 };
 
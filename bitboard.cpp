@@ -0,0 +1,237 @@
+// Bitboard backend for tactical reading. See bitboard.h
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "bitboard.h"
+#include "board.h"
+#include "globals.h"
+
+using namespace std;
+
+BitBoard::BitBoard(int bsize)
+{
+	assert(bsize<BB_STRIDE);
+	board_size=bsize;
+	neighbour_table=get_neighbour_table(board_size);
+	to_move=BLACK;
+	ko_marker=-1;
+	for(int i=0;i<board_size*board_size;i++) on_board.set(to_bit(i));
+	empty=on_board;
+}
+
+BitBoard::BitBoard(BoardState& b)
+{
+	assert(b.board_size<BB_STRIDE);
+	board_size=b.board_size;
+	neighbour_table=b.neighbour_table;
+	to_move=b.to_move;
+	ko_marker=b.ko_marker;
+	for(int i=0;i<board_size*board_size;i++)
+	{
+		on_board.set(to_bit(i));
+		if(b.board[i]==NO_LUMP) empty.set(to_bit(i));
+		else
+		{
+			if(b.colour(i)==BLACK) black.set(to_bit(i));
+			else white.set(to_bit(i));
+			if(b.is_invincible(i)) invincible.set(to_bit(i));
+		}
+	}
+}
+
+//Print the board state to the terminal
+void BitBoard::display(void)
+{
+	cout << "\n\n  ";
+	for(int i=0;i<board_size;i++){cout << i%10;}
+	cout<<"\n +";
+	for(int i=0;i<board_size;i++){cout << "-";}
+	cout << "+  "<<(to_move==BLACK ? "Black" : "White") <<" to move\n";
+	for(int j=0;j<board_size;j++)
+	{
+		cout << j%10 << "|";
+		for(int i=0;i<board_size;i++)
+		{
+			int b = i + BB_STRIDE*j;
+			if(empty.test(b)) cout<<(ko_marker==(board_size*j)+i ? ":" : ".");
+			else if(black.test(b)) cout<<(invincible.test(b) ? "k" : "X");
+			else cout<<(invincible.test(b) ? "c" : "O");
+		}
+		cout<<"|\n";
+	}
+	cout <<" +";
+	for(int i=0;i<board_size;i++){cout << "-";}
+	cout << "+\n";
+}
+
+BitSet BitBoard::dilate(const BitSet& s)
+{
+	return (s | s.shift_up(1) | s.shift_down(1) | s.shift_up(BB_STRIDE) | s.shift_down(BB_STRIDE)) & on_board;
+}
+
+BitSet BitBoard::diagonals(const BitSet& s)
+{
+	BitSet d = s.shift_up(BB_STRIDE-1) | s.shift_up(BB_STRIDE+1) | s.shift_down(BB_STRIDE-1) | s.shift_down(BB_STRIDE+1);
+	return d & on_board & ~s;
+}
+
+// Grow the lump one step at a time until it stops changing
+BitSet BitBoard::lump(int pos)
+{
+	BitSet result;
+	int b = to_bit(pos);
+	if(empty.test(b)) return result;
+	BitSet same = (black.test(b) ? black : white);
+	result.set(b);
+	while(true)
+	{
+		BitSet next = dilate(result) & same;
+		if(next==result) return result;
+		result = next;
+	}
+}
+
+int BitBoard::colour(int pos)
+{
+	int b = to_bit(pos);
+	if(black.test(b)) return BLACK;
+	if(white.test(b)) return WHITE;
+	return -1;
+}
+
+int BitBoard::liberties(int pos)
+{
+	return liberties(lump(pos));
+}
+
+int BitBoard::n_adj_liberties(int pos)
+{
+	BitSet s;
+	s.set(to_bit(pos));
+	return (dilate(s) & ~s & empty).count();
+}
+
+//Returns true if pos is a legal move for the current colour
+bool BitBoard::is_legal_move(int pos)
+{
+	if(pos==-1) return true;
+	if(!empty.test(to_bit(pos)) || pos==ko_marker) return false;
+	BitSet s;
+	s.set(to_bit(pos));
+	BitSet adj = dilate(s) & ~s;
+	if(!(adj & empty).none()) return true; // Ok if has liberties
+
+	// Otherwise ok if it joins a friend with another liberty, or captures something
+	BitSet friends = adj & stones(to_move);
+	if(!(friends & invincible).none()) return true;
+	while(!friends.none())
+	{
+		BitSet l = lump(to_pos(friends.first()));
+		if(liberties(l)>1) return true;
+		friends = friends & ~l;
+	}
+	BitSet enemies = adj & stones(not_to_move());
+	while(!enemies.none())
+	{
+		BitSet l = lump(to_pos(enemies.first()));
+		if(liberties(l)==1 && (l & invincible).none()) return true;
+		enemies = enemies & ~l;
+	}
+	return false;
+}
+
+// Play a move at given position, removing captured stones and setting the ko marker.
+// Asserts move is legal move, but checking should be done elsewhere.
+void BitBoard::play_move(int pos)
+{
+	assert(is_legal_move(pos));
+	ko_marker=-1;
+	if(pos==-1)
+	{
+		to_move=not_to_move();
+		return;
+	}
+
+	int b = to_bit(pos);
+	BitSet s;
+	s.set(b);
+	if(to_move==BLACK) black.set(b); else white.set(b);
+	empty.reset(b);
+
+	// Remove enemy lumps with no liberties left
+	BitSet adj = dilate(s);
+	BitSet enemies = adj & stones(not_to_move());
+	int captured=0;
+	while(!enemies.none())
+	{
+		BitSet l = lump(to_pos(enemies.first()));
+		enemies = enemies & ~l;
+		if(liberties(l)==0 && (l & invincible).none())
+		{
+			captured+=l.count();
+			if(to_move==BLACK) white = white & ~l; else black = black & ~l;
+			empty = empty | l;
+		}
+	}
+
+	// Detect ko: one stone captured by a lone stone which is left with one liberty
+	if(captured==1 && (adj & stones(to_move) & ~s).none() && n_adj_liberties(pos)==1)
+	{
+		ko_marker = to_pos((adj & empty).first());
+	}
+	to_move=not_to_move();
+}
+
+// Return the number of liberties a move at pos would end up with, including captures.
+// Return 1000 if it connects to an invincible group.
+int BitBoard::resulting_liberties(int pos, int colour)
+{
+	assert(empty.test(to_bit(pos)));
+	BitSet s;
+	s.set(to_bit(pos));
+	if(!(dilate(s) & stones(colour) & invincible).none()) return 1000;
+	// Boards are cheap to copy, so just play it and count
+	BitBoard copy = *this;
+	copy.ko_marker=-1;
+	copy.to_move=colour;
+	if(colour==BLACK) copy.black.set(to_bit(pos)); else copy.white.set(to_bit(pos));
+	copy.empty.reset(to_bit(pos));
+	BitSet enemies = copy.dilate(s) & copy.stones(copy.not_to_move());
+	while(!enemies.none())
+	{
+		BitSet l = copy.lump(to_pos(enemies.first()));
+		enemies = enemies & ~l;
+		if(copy.liberties(l)==0 && (l & invincible).none())
+		{
+			if(colour==BLACK) copy.white = copy.white & ~l; else copy.black = copy.black & ~l;
+			copy.empty = copy.empty | l;
+		}
+	}
+	return copy.liberties(pos);
+}
+
+// Push the liberties of the lump at pos onto output, in increasing order
+void BitBoard::lump_adj_liberties(int pos, vector<int>& output)
+{
+	BitSet libs = dilate(lump(pos)) & empty;
+	while(!libs.none())
+	{
+		int b = libs.first();
+		output.push_back(to_pos(b));
+		libs.reset(b);
+	}
+}
+
+// Push onto output one stone from each lump of given colour adjacent to the lump at pos
+// and with the given number of liberties (any number if liberties is -1)
+void BitBoard::lump_adj_lumps(int pos, int colour, int liberties, vector<int>& output)
+{
+	BitSet adj = dilate(lump(pos)) & stones(colour);
+	while(!adj.none())
+	{
+		BitSet l = lump(to_pos(adj.first()));
+		if(liberties==-1 || this->liberties(l)==liberties) output.push_back(to_pos(adj.first()));
+		adj = adj & ~l;
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef BITBOARD_H_300712
+#define BITBOARD_H_300712
+
+#include <vector>
+#include "globals.h"
+#include "board.h"
+#include "bitset.h"
+
+// Bitboard representation of a position, as an alternative to BoardState. Nothing reads on it yet:
+// the reader needs BoardState's lump ids and caches. The bitcheck console command checks it against
+// BoardState.
+// Lumps are never stored: they are recovered by flood fill when needed, and liberties are
+// counted by dilating a lump and masking with the empty points. The whole board is a few
+// hundred bytes of plain data, so copying it costs no more than a memcpy.
+
+// Point (x,y) is stored as bit x + BB_STRIDE*y of a padded 20x19 grid (380 bits, which is what
+// BitSet holds), large enough for 19x19. Column 19 is never on the board, so shifting a set one
+// step sideways cannot wrap from the end of one row onto the start of the next.
+const int BB_STRIDE = 20;
+
+class BitBoard
+{
+public:
+	BitBoard(int bsize); // Empty board
+	BitBoard(BoardState& b); // Same stones, ko marker and player to move as b
+	int board_size;
+	int to_move;
+	int not_to_move(void){return (to_move==BLACK ? WHITE : BLACK);}
+	int ko_marker;
+	const Neighbours* neighbour_table; // For the coordinates of each point (see board.h)
+
+	BitSet black;
+	BitSet white;
+	BitSet empty;
+	BitSet invincible; // Stones belonging to invincible lumps
+	BitSet on_board; // Mask of real points for this board size
+
+	// Conversion between board positions and bits
+	int to_bit(int pos){return neighbour_table[pos].x + BB_STRIDE*neighbour_table[pos].y;}
+	int to_pos(int bit){return bit%BB_STRIDE + board_size*(bit/BB_STRIDE);}
+
+	void display(void);
+	bool is_legal_move(int pos);
+	void play_move(int pos);
+
+	// Queries, with the same meaning as the BoardState functions of the same name
+	int colour(int pos);
+	int liberties(int pos);
+	bool is_invincible(int pos){return invincible.test(to_bit(pos));}
+	int n_adj_liberties(int pos);
+	int resulting_liberties(int pos, int colour);
+	void lump_adj_liberties(int pos, std::vector<int>& output);
+	void lump_adj_lumps(int pos, int colour, int liberties, std::vector<int>& output);
+
+	// Set operations
+	BitSet stones(int colour){return (colour==BLACK ? black : white);}
+	BitSet dilate(const BitSet& s); // s and its HV neighbours
+	BitSet diagonals(const BitSet& s); // Diagonal neighbours of s, not in s
+	BitSet lump(int pos); // Flood fill from pos through stones of the same colour
+	int liberties(const BitSet& lump){return (dilate(lump) & empty).count();}
+};
+
+#endif
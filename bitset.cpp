@@ -0,0 +1,105 @@
+// Fixed-size bit sets. See bitset.h
+#include <vector>
+#include "bitset.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+static int popcount64(unsigned long long x)
+{
+#if defined(_MSC_VER)
+	return (int)__popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+static int lowest_bit64(unsigned long long x)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return (int)index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+bool BitSet::none(void) const
+{
+	for(int i=0;i<BB_WORDS;i++) if(w[i]!=0) return false;
+	return true;
+}
+
+int BitSet::count(void) const
+{
+	int result=0;
+	for(int i=0;i<BB_WORDS;i++) result+=popcount64(w[i]);
+	return result;
+}
+
+int BitSet::first(void) const
+{
+	for(int i=0;i<BB_WORDS;i++) if(w[i]!=0) return 64*i + lowest_bit64(w[i]);
+	return -1;
+}
+
+void BitSet::list(vector<int>& output) const
+{
+	for(int i=0;i<BB_WORDS;i++)
+	{
+		for(unsigned long long x=w[i];x!=0;x&=x-1) output.push_back(64*i + lowest_bit64(x));
+	}
+}
+
+BitSet BitSet::operator&(const BitSet& other) const
+{
+	BitSet result;
+	for(int i=0;i<BB_WORDS;i++) result.w[i]=w[i]&other.w[i];
+	return result;
+}
+
+BitSet BitSet::operator|(const BitSet& other) const
+{
+	BitSet result;
+	for(int i=0;i<BB_WORDS;i++) result.w[i]=w[i]|other.w[i];
+	return result;
+}
+
+BitSet& BitSet::operator|=(const BitSet& other)
+{
+	for(int i=0;i<BB_WORDS;i++) w[i]|=other.w[i];
+	return *this;
+}
+
+BitSet BitSet::operator~(void) const
+{
+	BitSet result;
+	for(int i=0;i<BB_WORDS;i++) result.w[i]=~w[i];
+	return result;
+}
+
+bool BitSet::operator==(const BitSet& other) const
+{
+	for(int i=0;i<BB_WORDS;i++) if(w[i]!=other.w[i]) return false;
+	return true;
+}
+
+BitSet BitSet::shift_up(int n) const
+{
+	BitSet result;
+	for(int i=BB_WORDS-1;i>0;i--) result.w[i]=(w[i]<<n) | (w[i-1]>>(64-n));
+	result.w[0]=w[0]<<n;
+	return result;
+}
+
+BitSet BitSet::shift_down(int n) const
+{
+	BitSet result;
+	for(int i=0;i<BB_WORDS-1;i++) result.w[i]=(w[i]>>n) | (w[i+1]<<(64-n));
+	result.w[BB_WORDS-1]=w[BB_WORDS-1]>>n;
+	return result;
+}
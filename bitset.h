@@ -0,0 +1,35 @@
+#ifndef BITSET_H_300712
+#define BITSET_H_300712
+
+#include <vector>
+
+// Fixed-size set of small integers, one bit each. Used for the bitboards (see bitboard.h) and for
+// the liberties of each lump on a BoardState, indexed by board position.
+const int BB_WORDS = 6; // 384 bits: enough for 20*19 padded bitboards and for 19*19 positions
+
+class BitSet
+{
+public:
+	unsigned long long w[BB_WORDS];
+
+	BitSet(void){clear();}
+	void clear(void){for(int i=0;i<BB_WORDS;i++) w[i]=0;}
+	void set(int bit){w[bit>>6] |= (1ULL<<(bit&63));}
+	void reset(int bit){w[bit>>6] &= ~(1ULL<<(bit&63));}
+	bool test(int bit) const {return (w[bit>>6]>>(bit&63))&1;}
+	bool none(void) const;
+	int count(void) const; // Number of set bits
+	int first(void) const; // Lowest set bit, or -1 if empty
+	void list(std::vector<int>& output) const; // Push every set bit onto output, in increasing order
+
+	BitSet operator&(const BitSet& other) const;
+	BitSet operator|(const BitSet& other) const;
+	BitSet& operator|=(const BitSet& other);
+	BitSet operator~(void) const;
+	bool operator==(const BitSet& other) const;
+	bool operator!=(const BitSet& other) const {return !(*this==other);}
+	BitSet shift_up(int n) const; // Towards higher bits (0<n<64)
+	BitSet shift_down(int n) const; // Towards lower bits (0<n<64)
+};
+
+#endif
@@ -1,13 +1,15 @@
-//Contains the board data structure and methods for reading and updating it. It also contains the lump class
+//Contains the board data structure and methods for reading and updating it. It also contains the lump storage
 //
 #include <algorithm>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <assert.h>
 #include "board.h"
+#include "hashing.h"
 #include "globals.h"
 
 
@@ -15,87 +17,77 @@ using namespace std;
 
 
 //A lump is a string of solidly-connected stones on the board. Lumps (rather than individual stones) are the basic tactical unit,
-//so the lumps are tracked by the board state and updated as each move is played. The list of board positions is stored as an STL vector.
+//so the lumps are tracked by the board state and updated as each move is played. Each lump has an id, which indexes the
+//lump_* arrays of the board, and its stones are linked in a circular list through next_stone.
 
 
 
-
-//Create a new lump of one stone, colour c, position pos
-Lump::Lump(int pos, int c)
+// Neighbour tables are built the first time a board of a given size is created, and then shared
+// by every board (and copy) of that size. Neighbours are listed in the same order adj_points always used.
+const Neighbours* get_neighbour_table(int board_size)
 {
-	stones.push_back(pos);
-	index=pos;
-	colour=c;
-	liberties=4;
-	invincible=false;
-}
+	static map<int, vector<Neighbours> > tables;
+	static mutex tables_lock; // Boards may be created in several reading threads at once
+	lock_guard<mutex> lock(tables_lock);
+	map<int, vector<Neighbours> >::iterator ii = tables.find(board_size);
+	if(ii!=tables.end()) return &(ii->second[0]);
 
-string Lump::display(void)
-{
-	stringstream ss;
-	ss << "Lump "<<size()<<" stones:";
-	if(invincible) ss<<" (invincible) ";
-	for(vector<int>::iterator ii=stones.begin();ii!=stones.end();ii++)
+	vector<Neighbours>& table = tables[board_size];
+	table.resize(board_size*board_size);
+	for(int pos=0;pos<board_size*board_size;pos++)
 	{
-		ss<<" ("<<(*ii)%DEBUG_BS<<","<<(int)(*ii/DEBUG_BS)<<")";
+		Neighbours& n = table[pos];
+		n.x=pos%board_size;
+		n.y=pos/board_size;
+		bool top = pos<board_size;
+		bool bottom = pos>=board_size*(board_size-1);
+		bool left = pos%board_size==0;
+		bool right = pos%board_size==board_size-1;
+		n.n_hv=0;
+		if(!top) n.points[n.n_hv++]=pos-board_size;
+		if(!bottom) n.points[n.n_hv++]=pos+board_size;
+		if(!left) n.points[n.n_hv++]=pos-1;
+		if(!right) n.points[n.n_hv++]=pos+1;
+		n.n_diag=0;
+		if(!top && !left) n.points[n.n_hv+n.n_diag++]=pos-board_size-1;
+		if(!top && !right) n.points[n.n_hv+n.n_diag++]=pos-board_size+1;
+		if(!bottom && !left) n.points[n.n_hv+n.n_diag++]=pos+board_size-1;
+		if(!bottom && !right) n.points[n.n_hv+n.n_diag++]=pos+board_size+1;
 	}
-	ss<<(colour==BLACK ? "\nBlack, " : "\nWhite, ");
-	ss<<liberties<<" liberties";
-
-	return ss.str();	
+	return &table[0];
 }
 
-//The board comprises an array of pointers to objects of type "lump", the integer board_size, a to_move marker, and a ko_point marker.
+//The board comprises an array of lump ids, the lump arrays, the integer board_size, a to_move marker, and a ko_point marker.
 //Everything else (captured stones, komi, time, move history) handled by gamestate object. This is the object used for reading.
 
-BoardState::BoardState(int b)
+BoardState::BoardState(int b): BoardData()
 {
+	assert(b<=MAX_BOARD_SIZE);
 	board_size=b;
-	board.resize(board_size*board_size, NULL);
+	neighbour_table=get_neighbour_table(board_size);
 	to_move=BLACK;
 	ko_marker=-1;
 	hash_value=0;
 	hash=NULL;
-}
-
-BoardState::BoardState(const BoardState& other)
-{
-	board_size=other.board_size;
-	to_move=other.to_move;
-	ko_marker=other.ko_marker;
-	hash=other.hash;
-	hash_value=other.hash_value;
-
-	map<Lump*, Lump*> already_done;
-	map<Lump*,Lump*>::iterator jj;
-	for(vector<Lump*>::const_iterator ii=other.board.begin();ii!=other.board.end();ii++)
+	touched.clear();
+	guard_moves=-1;
+	for(int i=0;i<MAX_POINTS;i++)
 	{
-		if(*ii==NULL)
-		{
-			board.push_back(NULL);
-			continue;
-		}
-		if((jj=already_done.find(*ii))==already_done.end())
-		{
-			Lump* new_lump = new Lump(**ii);
-			already_done.insert(pair<Lump*,Lump*>(*ii, new_lump));
-			board.push_back(new_lump);
-		} else {
-			board.push_back(jj->second);
-		}
+		board[i]=NO_LUMP;
+		next_stone[i]=i;
+		point_cache[i].n_empty=(i<board_size*board_size ? neighbour_table[i].n_hv : 0);
+		point_cache[i].n_lumps=0;
 	}
+	n_lumps=0;
+	n_free=0;
+	for(int id=MAX_LUMPS-1;id>NO_LUMP;id--) free_ids[n_free++]=id; // Low ids come off the stack first
 }
-//Destructor must delete all Lump objects
-BoardState::~BoardState(void)
+
+// The position is plain data, so copying it is a single memcpy. The copy has no history, so no
+// region of a node to start from either.
+BoardState::BoardState(const BoardState& other): BoardData(other)
 {
-	vector<Lump*>::iterator ii;
-	for(ii=board.begin();ii!=board.end();ii++)
-	{
-		if(*ii!=NULL)
-		{
-			delete_lump(*ii);
-		}
-	}
+	guard_moves=-1;
 }
 
 //Print the board state to the terminal
@@ -111,15 +103,16 @@ void BoardState::display(void)
 		cout << j%10 << "|";
 		for(int i=0;i<board_size;i++)
 		{
-			if(board[(board_size*j)+i]==NULL)
+			int pos=(board_size*j)+i;
+			if(board[pos]==NO_LUMP)
 			{
-				cout<<(ko_marker==(board_size*j)+i ? ":" : ".");
+				cout<<(ko_marker==pos ? ":" : ".");
 			} else {
-				if(board[(board_size*j)+i]->colour==BLACK)
+				if(colour(pos)==BLACK)
 				{
-					cout<<(board[(board_size*j)+i]->invincible ? "k" : "X");
+					cout<<(is_invincible(pos) ? "k" : "X");
 				} else {
-					cout<<(board[(board_size*j)+i]->invincible ? "c" : "O");
+					cout<<(is_invincible(pos) ? "c" : "O");
 				}
 			}
 		}
@@ -132,127 +125,487 @@ void BoardState::display(void)
 	cout << "+\n";
 }	
 
+string BoardState::display_lump(int lump)
+{
+	stringstream ss;
+	ss << "Lump "<<lump_size[lump]<<" stones:";
+	if(lump_invincible[lump]) ss<<" (invincible) ";
+	int s=lump_stone[lump];
+	do
+	{
+		ss<<" ("<<neighbour_table[s].x<<","<<neighbour_table[s].y<<")";
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	ss<<(lump_colour[lump]==BLACK ? "\nBlack, " : "\nWhite, ");
+	ss<<lump_liberties[lump]<<" liberties";
+
+	return ss.str();	
+}
+
 //Returns true if pos is a legal move for the current colour
 bool BoardState::is_legal_move(int pos)
 {
 	if(pos==-1) return true;
-	if(board[pos]!=NULL || pos==ko_marker){return false;} //Must be empty, not ko
-	if(n_adj_liberties(pos, HV)>0){return true;} //Ok if has liberties. If not...
+	if(board[pos]!=NO_LUMP || pos==ko_marker){return false;} //Must be empty, not ko
 
-	vector<Lump*> adj_enemies;
-	adj_lumps(pos, HV, ENEMY, adj_enemies);
-	for(vector<Lump*>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
+	if(point_cache[pos].n_empty>0){return true;} //Ok if has liberties
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
 	{
-		if((*ii)->liberties==1 && (!(*ii)->invincible)){return true;} //Return true if neighbour in atari and not invincible
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==to_move)
+		{
+			if(lump_liberties[l]>1 || lump_invincible[l]){return true;} //Ok if friend has more than one lib or invincible
+		} else {
+			if(lump_liberties[l]==1 && !lump_invincible[l]){return true;} //Ok if neighbour in atari and not invincible
+		}
 	}
-	vector<Lump*> adj_friends;
-	adj_lumps(pos, HV, FRIEND, adj_friends);
-	for(vector<Lump*>::iterator ii=adj_friends.begin();ii!=adj_friends.end();ii++)
+
+	return false;
+}
+
+// Take an id off the free stack for a new lump of one stone, and add it to the end of the live list.
+// Its liberties are the empty points next to pos.
+int BoardState::new_lump(int pos, int colour)
+{
+	assert(n_free>0);
+	int id=free_ids[--n_free];
+	lump_colour[id]=colour;
+	lump_size[id]=1;
+	lump_stone[id]=pos;
+	lump_invincible[id]=false;
+	lump_box[id].clear();
+	lump_box[id].add(neighbour_table[pos].x, neighbour_table[pos].y);
+	set_point(pos, id);
+	next_stone[pos]=pos;
+	lump_liberty_set[id].clear();
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
 	{
-		if((*ii)->liberties>1 || (*ii)->invincible){return true;} //Return true if friend has more than one lib or invincible
+		if(board[*ii]==NO_LUMP) lump_liberty_set[id].set(*ii);
 	}
+	lump_liberties[id]=lump_liberty_set[id].count();
+	live_index[id]=n_lumps;
+	live_lumps[n_lumps++]=id;
+	return id;
+}
 
-	return false;
+// Take an id out of the live list (the last live lump takes its place) and push it onto the free stack
+void BoardState::free_lump(int lump)
+{
+	int i=live_index[lump];
+	int last=live_lumps[--n_lumps];
+	live_lumps[i]=last;
+	live_index[last]=i;
+	free_ids[n_free++]=lump;
 }
 
-//To delete a lump, set all board positions listed in stones vector to NULL, then delete.
+void BoardState::save_lump(int lump, LumpRecord& record)
+{
+	record.id=lump;
+	record.colour=lump_colour[lump];
+	record.size=lump_size[lump];
+	record.liberties=lump_liberties[lump];
+	record.stone=lump_stone[lump];
+	record.live_index=live_index[lump];
+	record.invincible=lump_invincible[lump];
+	record.box=lump_box[lump];
+}
+
+// The reverse of free_lump: the id must be the one on top of the free stack. Its stones and
+// liberty set are left alone.
+void BoardState::restore_lump(const LumpRecord& record)
+{
+	int id=record.id;
+	assert(n_free>0 && free_ids[n_free-1]==id);
+	n_free--;
+	lump_colour[id]=record.colour;
+	lump_size[id]=record.size;
+	lump_liberties[id]=record.liberties;
+	lump_stone[id]=record.stone;
+	lump_invincible[id]=record.invincible;
+	lump_box[id]=record.box;
+	int i=record.live_index;
+	if(i<n_lumps)
+	{
+		// Move the lump that took its place back to the end
+		live_lumps[n_lumps]=live_lumps[i];
+		live_index[live_lumps[i]]=n_lumps;
+	}
+	n_lumps++;
+	live_lumps[i]=id;
+	live_index[id]=i;
+}
+
+// Put a lump straight onto empty points of the board, without playing any moves. This is for setting
+// up positions (e.g. the invincible stones in get_status_in_box): it does not touch the hash or the
+// neighbouring lumps, and cannot be undone. Returns the id of the new lump.
+int BoardState::add_lump(const vector<int>& stones, int colour, bool invincible)
+{
+	assert(!stones.empty() && history.empty());
+	int id=new_lump(stones[0], colour);
+	for(vector<int>::const_iterator ii=stones.begin()+1;ii!=stones.end();ii++)
+	{
+		assert(board[*ii]==NO_LUMP);
+		set_point(*ii, id);
+		lump_box[id].add(neighbour_table[*ii].x, neighbour_table[*ii].y);
+		next_stone[*ii]=next_stone[stones[0]];
+		next_stone[stones[0]]=*ii;
+	}
+	lump_size[id]=stones.size();
+	lump_invincible[id]=invincible;
+	recalculate_liberties(id);
+	return id;
+}
+
+//To remove a lump, set all its board positions to NO_LUMP. The id and the stone list are left alone
+//(play_move frees the id separately, and undo_move puts the stones back from the list).
 //Return number of stones in the lump.
-int BoardState::delete_lump(Lump* target)
+template<class Hash> int BoardState::remove_lump(Hash& h, int lump)
+{
+	assert(lump!=NO_LUMP);
+	int s=lump_stone[lump];
+	do
+	{
+		set_point(s, NO_LUMP); //set board entry to NO_LUMP
+		h.remove_stone(*this, s, lump_colour[lump]); // Update hash
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	return lump_size[lump];
+}
+
+// Add the stone at pos to an existing lump, straight after lump_stone in its list (so that undo_move
+// can take it out again). The empty points next to pos become liberties of the lump.
+void BoardState::extend_lump(int lump, int pos)
+{
+	set_point(pos, lump);
+	next_stone[pos]=next_stone[lump_stone[lump]];
+	next_stone[lump_stone[lump]]=pos;
+	lump_size[lump]++;
+	lump_box[lump].add(neighbour_table[pos].x, neighbour_table[pos].y);
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
+	{
+		if(board[*ii]==NO_LUMP && !lump_liberty_set[lump].test(*ii))
+		{
+			lump_liberty_set[lump].set(*ii);
+			lump_liberties[lump]++;
+		}
+	}
+}
+
+//Merge lump2 into lump1, update board. lump2's fields are left as they were for undo_move.
+//Swapping the successors of one stone from each list joins the two circular lists into one
+//(and swapping them back splits it again).
+void BoardState::merge_two_lumps(int lump1, int lump2)
+{
+	int s=lump_stone[lump2];
+	do
+	{
+		set_point(s, lump1);
+		s=next_stone[s];
+	} while(s!=lump_stone[lump2]);
+	swap(next_stone[lump_stone[lump1]], next_stone[lump_stone[lump2]]);
+	lump_size[lump1]+=lump_size[lump2];
+	lump_box[lump1].add(lump_box[lump2]);
+	lump_liberty_set[lump1]|=lump_liberty_set[lump2];
+	lump_liberties[lump1]=lump_liberty_set[lump1].count();
+	if(lump_invincible[lump2]) lump_invincible[lump1]=true;
+}
+
+// Rebuild the liberty set of a lump from its stones. play_move keeps liberties up to date by itself,
+// so this is only needed for lumps put on the board some other way.
+int BoardState::recalculate_liberties(int lump)
 {
-	assert(target!=NULL);
-	vector<int>::iterator ii;
-	for(ii=target->stones.begin();ii!=target->stones.end();ii++)
+	lump_liberty_set[lump].clear();
+	int s=lump_stone[lump];
+	do
 	{
-		board[*ii]=NULL; //set board entry to NULL
-		hash->remove_stone(*ii, target->colour, hash_value); // Update hash
+		const Neighbours& n = neighbour_table[s];
+		for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
+		{
+			if(board[*ii]==NO_LUMP) lump_liberty_set[lump].set(*ii);
+		}
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	lump_liberties[lump]=lump_liberty_set[lump].count();
+	return lump_liberties[lump];
+}
+
+// Make pos a liberty of every lump of the given colour next to it (if it isn't already)
+void BoardState::add_liberty(int pos, int colour)
+{
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
+	{
+		int l=board[*ii];
+		if(l!=NO_LUMP && lump_colour[l]==colour && !lump_liberty_set[l].test(pos))
+		{
+			lump_liberty_set[l].set(pos);
+			lump_liberties[l]++;
+		}
 	}
-	int size=target->size();
-	delete target;
-	return size;
 }
 
-//Merge lump2 into lump1. Delete lump2, update board
-void BoardState::merge_two_lumps(Lump& lump1, Lump& lump2)
+// Take pos away from the liberties of every lump of the given colour next to it
+void BoardState::remove_liberty(int pos, int colour)
 {
-	lump1.stones.insert(lump1.stones.end(), lump2.stones.begin(), lump2.stones.end());
-	lump1.index = min(lump1.index, lump2.index);
-	for(vector<int>::iterator ii=lump2.stones.begin(); ii!=lump2.stones.end(); ii++)
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
 	{
-		board[*ii]=&lump1;
+		int l=board[*ii];
+		if(l!=NO_LUMP && lump_colour[l]==colour && lump_liberty_set[l].test(pos))
+		{
+			lump_liberty_set[l].reset(pos);
+			lump_liberties[l]--;
+		}
 	}
-	if(lump1.invincible||lump2.invincible) lump1.invincible=true;
-	delete &lump2;
 }
 
-int BoardState::recalculate_liberties(Lump& target)
+// Put lump (or NO_LUMP) at pos, keeping the cached data of the points next to pos up to date.
+// Each neighbour counts how many of its points hold each lump in its list, so a lump drops out
+// of the list when its last stone next to that point is removed or relabelled.
+void BoardState::set_point(int pos, int lump)
 {
-	vector<int> liberty_list;
-	for(vector<int>::iterator ii=target.stones.begin();ii!=target.stones.end();ii++)
+	int old=board[pos];
+	board[pos]=lump;
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
 	{
-		adj_liberties(*ii,HV,liberty_list);
+		PointCache& c = point_cache[*ii];
+		if(old==NO_LUMP) c.n_empty--;
+		else
+		{
+			int i=0;
+			while(c.lumps[i]!=old) i++;
+			if(--c.count[i]==0)
+			{
+				c.n_lumps--;
+				for(;i<c.n_lumps;i++){c.lumps[i]=c.lumps[i+1]; c.count[i]=c.count[i+1];}
+			}
+		}
+		if(lump==NO_LUMP) c.n_empty++;
+		else
+		{
+			int i=0;
+			while(i<c.n_lumps && c.lumps[i]<lump) i++;
+			if(i<c.n_lumps && c.lumps[i]==lump) c.count[i]++;
+			else
+			{
+				// Insert at i, keeping the list in increasing order
+				for(int j=c.n_lumps;j>i;j--){c.lumps[j]=c.lumps[j-1]; c.count[j]=c.count[j-1];}
+				c.lumps[i]=lump;
+				c.count[i]=1;
+				c.n_lumps++;
+			}
+		}
 	}
-	sort(liberty_list.begin(), liberty_list.end());
-	liberty_list.erase(unique(liberty_list.begin(),liberty_list.end()),liberty_list.end());
-	target.liberties = liberty_list.size();
-	return liberty_list.size();
 }
+
 // Play a move at given position. Perform relevant captures, merge lumps, update ko position,
 // increment to_move. Return number of captured stones (return negative number for suicide).
 // Asserts move is legal move, but checking should be done elsewhere.
-// Also updates hash value in place by calling hash.add/remove_stone
-void BoardState::play_move(int pos)
+// Also updates the hash values in place by calling h.add/remove_stone, change_ko and change_to_move
+// Pushes an UndoRecord onto history so that the move can be taken back with undo_move.
+// Liberty sets are updated as the move goes: the new stone takes a liberty from each
+// neighbour, and each captured stone becomes a liberty of the lumps next to it.
+template<class Hash> void BoardState::play_move(Hash& h, int pos)
 {
 	assert(is_legal_move(pos));
+	UndoRecord record;
+	record.pos=pos;
+	record.ko_marker=ko_marker;
+	record.hash_value=hash_value;
+	for(int i=0;i<N_HASH_VARIANTS;i++) record.variant_hash[i]=variant_hash[i];
+	record.n_merged=0;
+	record.n_captured=0;
+
 	ko_marker=-1;
 	// Deal with pass separately
 	if(pos==-1)
 	{
+		h.change_ko(*this, record.ko_marker, ko_marker);
 		to_move=(to_move==BLACK ? WHITE : BLACK);
+		h.change_to_move(*this);
+		history.push_back(record);
 		return;
 	} else {
 		// Otherwise, have to update hash
-		hash->add_stone(pos, to_move, hash_value);
+		h.add_stone(*this, pos, to_move);
+		touched.add(neighbour_table[pos].x, neighbour_table[pos].y);
 	}
 
-	board[pos]= new Lump(pos, to_move);
-	vector<Lump*> adj_friends;
-	vector<Lump*> adj_enemies;
-	adj_lumps(pos, HV, FRIEND, adj_friends);
-	adj_lumps(pos, HV, ENEMY, adj_enemies);
-	// Merge
-	for(vector<Lump*>::iterator ii = adj_friends.begin();ii!=adj_friends.end();ii++)
+	// Distinct neighbouring lumps come from the point's cached list. The liberties of those that
+	// will be merged are saved before anything changes.
+	int adj_friends[4]; int n_friends=0;
+	int to_capture[4]; int n_to_capture=0;
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
 	{
-		merge_two_lumps(*board[pos], **ii);
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==to_move)
+		{
+			record.merged_liberties[n_friends]=lump_liberty_set[l];
+			adj_friends[n_friends++]=l;
+		} else if(lump_liberties[l]==1 && !lump_invincible[l])
+		{
+			to_capture[n_to_capture++]=l;
+		}
 	}
-	// Delete captured stones
-	int captured=0;
-	vector<Lump*> store;
-	for(vector<Lump*>::iterator ii = adj_enemies.begin();ii!=adj_enemies.end();ii++)
+
+	record.next_stone=next_stone[pos];
+	remove_liberty(pos, to_move);
+	remove_liberty(pos, not_to_move());
+	int lump;
+	if(n_friends==0)
 	{
-		if((*ii)->liberties==1 && !(*ii)->invincible)
+		lump=new_lump(pos, to_move);
+	} else {
+		// The stone joins the largest friendly lump, which keeps its id, and the others are merged
+		// into that one. Only the stones of the smaller lumps are relabelled.
+		int largest=0;
+		for(int i=1;i<n_friends;i++)
 		{
-			// Store lumps adjacent to captured lump, to update liberties later
-			lump_adj_lumps(*ii, HV, FRIEND, store);
-			captured+=delete_lump(*ii);
+			if(lump_size[adj_friends[i]]>lump_size[adj_friends[largest]]) largest=i;
+		}
+		swap(adj_friends[0], adj_friends[largest]);
+		swap(record.merged_liberties[0], record.merged_liberties[largest]);
+		lump=adj_friends[0];
+		save_lump(lump, record.merged[record.n_merged++]);
+		extend_lump(lump, pos);
+		for(int i=1;i<n_friends;i++)
+		{
+			save_lump(adj_friends[i], record.merged[record.n_merged++]);
+			merge_two_lumps(lump, adj_friends[i]);
+			free_lump(adj_friends[i]);
 		}
 	}
+	// Delete captured stones. Each one becomes a liberty of the lumps next to it.
+	int captured=0;
+	for(int i=0;i<n_to_capture;i++)
+	{
+		int e=to_capture[i];
+		save_lump(e, record.captured[record.n_captured++]);
+		captured+=remove_lump(h, e);
+		free_lump(e);
+		int s=lump_stone[e];
+		do
+		{
+			add_liberty(s, to_move);
+			s=next_stone[s];
+		} while(s!=lump_stone[e]);
+	}
 	// Detect ko
-	if(captured==1 && adj_friends.size()==0 && n_adj_liberties(pos, HV)==1)
+	if(captured==1 && n_friends==0 && point_cache[pos].n_empty==1)
 	{
-		vector<int> libs;
-		adj_liberties(pos, HV, libs);
-		ko_marker=libs[0];
+		const Neighbours& n = neighbour_table[pos];
+		for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
+		{
+			if(board[*ii]==NO_LUMP) ko_marker=*ii;
+		}
 	}
 
-	// Recalculate liberties of relevant lumps
-	adj_lumps(pos, HV, ENEMY, store);
-	store.push_back(board[pos]);
-	for(vector<Lump*>::iterator ii = store.begin();ii!=store.end();ii++)
-	{
-		recalculate_liberties(**ii);
-	}	
 	// (If you change this bit, don't forget to change the pass behaviour above)
+	h.change_ko(*this, record.ko_marker, ko_marker);
 	to_move=(to_move==BLACK ? WHITE : BLACK);
+	h.change_to_move(*this);
+	// The hash value is final, so the table can start fetching the entries for this position
+	h.prefetch(*this);
+	history.push_back(record);
+}
+
+// Boards with no table hash with this
+static NullHash no_table;
+
+// The hash policy is picked once per move, so everything play_move does for each stone is a direct call
+void BoardState::play_move(int pos)
+{
+	if(hash!=NULL) play_move(*hash, pos);
+	else play_move(no_table, pos);
+}
+
+void BoardState::clear_ko(void)
+{
+	if(hash!=NULL) hash->change_ko(*this, ko_marker, -1);
+	else no_table.change_ko(*this, ko_marker, -1);
+	ko_marker=-1;
+}
+
+// Take back the last move played. Everything play_move did is reversed in the opposite order, so the
+// merged and captured lumps get their old ids back and ids held elsewhere (e.g. the engine's
+// lump_data) stay valid across play/undo.
+void BoardState::undo_move(void)
+{
+	assert(!history.empty());
+	const UndoRecord& record = history.back();
+	to_move=(to_move==BLACK ? WHITE : BLACK);
+	ko_marker=record.ko_marker;
+	hash_value=record.hash_value;
+	for(int i=0;i<N_HASH_VARIANTS;i++) variant_hash[i]=record.variant_hash[i];
+	if(record.pos!=-1)
+	{
+		int pos=record.pos;
+		int lump=board[pos];
+		// Put back captured stones. Their only liberty was pos.
+		for(int i=record.n_captured-1;i>=0;i--)
+		{
+			const LumpRecord& r = record.captured[i];
+			restore_lump(r);
+			lump_liberties[r.id]=1;
+			int s=r.stone;
+			do
+			{
+				set_point(s, r.id);
+				s=next_stone[s];
+			} while(s!=r.stone);
+			lump_liberty_set[r.id].clear();
+			lump_liberty_set[r.id].set(pos);
+		}
+		if(record.n_merged==0)
+		{
+			assert(n_lumps>0 && live_lumps[n_lumps-1]==lump);
+			free_lump(lump);
+		} else {
+			// Split off the lumps that were merged into the one pos joined, with their old liberties
+			assert(lump==record.merged[0].id);
+			for(int i=record.n_merged-1;i>0;i--)
+			{
+				const LumpRecord& r = record.merged[i];
+				swap(next_stone[lump_stone[lump]], next_stone[r.stone]);
+				restore_lump(r);
+				lump_liberty_set[r.id]=record.merged_liberties[i];
+				lump_liberties[r.id]=record.merged_liberties[i].count();
+				int s=r.stone;
+				do
+				{
+					set_point(s, r.id);
+					s=next_stone[s];
+				} while(s!=r.stone);
+			}
+			// Then take pos back out of it (extend_lump put it straight after lump_stone)
+			const LumpRecord& r = record.merged[0];
+			assert(next_stone[r.stone]==pos);
+			next_stone[r.stone]=next_stone[pos];
+			lump_size[lump]=r.size;
+			lump_invincible[lump]=r.invincible;
+			lump_box[lump]=r.box;
+			lump_liberty_set[lump]=record.merged_liberties[0];
+			lump_liberties[lump]=record.merged_liberties[0].count();
+		}
+		set_point(pos, NO_LUMP);
+		next_stone[pos]=record.next_stone;
+
+		// The captured stones are no longer liberties of anything, and pos is a liberty again
+		for(int i=0;i<record.n_captured;i++)
+		{
+			int s=record.captured[i].stone;
+			do
+			{
+				remove_liberty(s, to_move);
+				s=next_stone[s];
+			} while(s!=record.captured[i].stone);
+		}
+		add_liberty(pos, not_to_move());
+	}
+	history.pop_back();
 }
 
 //Returns BLACK, WHITE or interprets FRIEND, ENEMY relative to board.to_move
@@ -274,9 +627,8 @@ int BoardState::interpret_other_colour(int colour)
 // Push to output a list of all points in a taxicab radius of r from pos
 void BoardState::taxicab_radius(int pos, int r, std::vector<int>& output)
 {
-	int i, j;
-	i=pos%board_size;
-	j=(int)pos/board_size;
+	int i=neighbour_table[pos].x;
+	int j=neighbour_table[pos].y;
 	for(int k=-r;k<=r;k++)
 	{ for(int l=-r;l<=r;l++)
 	{
@@ -287,14 +639,14 @@ void BoardState::taxicab_radius(int pos, int r, std::vector<int>& output)
 	}}
 }
 // Push to output a list of all lumps in a taxicab radius of r from pos
-void BoardState::taxicab_radius_lumps(int pos, int r, std::vector<Lump*>& output)
+void BoardState::taxicab_radius_lumps(int pos, int r, std::vector<int>& output)
 {
 	vector<int> store;
-	vector<Lump*> store2;
+	vector<int> store2;
 	taxicab_radius(pos, r, store);
 	for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 	{
-		if(board[*ii]!=NULL) store2.push_back(board[*ii]);
+		if(board[*ii]!=NO_LUMP) store2.push_back(board[*ii]);
 	}
 	sort(store2.begin(), store2.end());
 	store2.erase(unique(store2.begin(), store2.end()),store2.end());
@@ -302,99 +654,112 @@ void BoardState::taxicab_radius_lumps(int pos, int r, std::vector<Lump*>& output
 	
 }
 
+// Push the stones of a lump onto output
+void BoardState::lump_stones(int lump, std::vector<int>& output)
+{
+	assert(lump!=NO_LUMP);
+	int s=lump_stone[lump];
+	do
+	{
+		output.push_back(s);
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+}
+
 //Push all adjacent board positions into output vector. Choose horizontal/vertical, diagonal,
 //or both with directions= HV, DIAG, HVDIAG. Output is board positions (integers)
 void BoardState::adj_points(int pos, int directions, vector<int>& output)
 {
 	assert(pos>=0);
-	int on_edge=0; //bit 1 for top edge, bit 2 for bottom edge, 4 for left, 8 for right
-	if(pos<board_size){on_edge+=1;}
-	if(pos>=board_size*(board_size-1)){on_edge+=2;}
-	if(pos%board_size==0){on_edge+=4;}
-	if(pos%board_size==board_size-1){on_edge+=8;}
-
-	if((directions&HV)!=0) // if reporting horizontal/vertical locations
-	{
-		if((on_edge&1)==0){output.push_back(pos-board_size);}
-		if((on_edge&2)==0){output.push_back(pos+board_size);}
-		if((on_edge&4)==0){output.push_back(pos-1);}
-		if((on_edge&8)==0){output.push_back(pos+1);}
-	}
-
-	if((directions&DIAG)!=0) // if reporting diagonal locations
-	{
-		if((on_edge&5)==0){output.push_back(pos-board_size-1);}
-		if((on_edge&9)==0){output.push_back(pos-board_size+1);}
-		if((on_edge&6)==0){output.push_back(pos+board_size-1);}
-		if((on_edge&10)==0){output.push_back(pos+board_size+1);}
-	}
+	const Neighbours& n = neighbour_table[pos];
+	output.insert(output.end(), n.begin(directions), n.end(directions));
 }
 
 void BoardState::adj_liberties(int pos, int directions, vector<int>& output)
 {
 	assert(pos>=0);
-	vector<int> store;
-	adj_points(pos, directions, store);
-	for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
 	{
-		if(board[*ii]==NULL){output.push_back(*ii);}
+		if(board[*ii]==NO_LUMP){output.push_back(*ii);}
 	}
 }
 
 int BoardState::n_adj_liberties(int pos, int directions)
 {
 	assert(pos>=0);
-	vector<int> store;
-	adj_liberties(pos, directions, store);
-	return store.size();
-}
-
-void BoardState::lump_adj_points(int pos, int directions, std::vector<int>& output)
-{
-	assert(pos>=0);
-	lump_adj_points(board[pos], directions, output);
-}
-void BoardState::lump_adj_points(Lump* target, int directions, std::vector<int>& output)
-{
-	vector<int> store;
-	for(vector<int>::iterator ii=target->stones.begin();ii!=target->stones.end();ii++)
+	if(directions==HV) return point_cache[pos].n_empty;
+	int result=0;
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
 	{
-		adj_points(*ii, directions, store);
+		if(board[*ii]==NO_LUMP) result++;
 	}
-	sort(store.begin(), store.end());
-	store.erase(unique(store.begin(), store.end()),store.end());
-	for(vector<int>::iterator ii = store.begin();ii!=store.end();ii++){output.push_back(*ii);}
+	return result;
 }
 
-void BoardState::lump_adj_liberties(int pos, int directions, std::vector<int>& output)
+// The lump_adj_* functions append straight onto output, then sort and remove duplicates
+// from the appended part only (so existing contents of output are left alone, as before).
+void BoardState::lump_adj_points(int lump, int directions, std::vector<int>& output)
 {
-	assert(pos>=0);
-	lump_adj_liberties(board[pos], directions, output);
+	assert(lump!=NO_LUMP);
+	size_t start=output.size();
+	int s=lump_stone[lump];
+	do
+	{
+		adj_points(s, directions, output);
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	sort(output.begin()+start, output.end());
+	output.erase(unique(output.begin()+start, output.end()),output.end());
 }
-void BoardState::lump_adj_liberties(Lump* target, int directions, std::vector<int>& output)
+
+// HV liberties come straight from the lump's liberty set, already in order
+void BoardState::lump_adj_liberties(int lump, int directions, std::vector<int>& output)
 {
-	assert(target!=NULL);
-	vector<int> store;
-	for(vector<int>::iterator ii=target->stones.begin();ii!=target->stones.end();ii++)
+	assert(lump!=NO_LUMP);
+	if(directions==HV)
 	{
-		adj_liberties(*ii, directions, store);
+		lump_liberty_set[lump].list(output);
+		return;
 	}
-	sort(store.begin(), store.end());
-	store.erase(unique(store.begin(), store.end()),store.end());
-	for(vector<int>::iterator ii = store.begin();ii!=store.end();ii++){output.push_back(*ii);}
+	size_t start=output.size();
+	int s=lump_stone[lump];
+	do
+	{
+		adj_liberties(s, directions, output);
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	sort(output.begin()+start, output.end());
+	output.erase(unique(output.begin()+start, output.end()),output.end());
 }
 
-int BoardState::lump_n_adj_liberties(int pos, int directions)
-{
-	assert(pos>=0);
-	return lump_n_adj_liberties(board[pos], directions);
-}
-int BoardState::lump_n_adj_liberties(Lump* target, int directions)
+// HV liberties are already counted. Other directions are counted without building a list: each
+// liberty is counted once, from the lowest-numbered stone of the lump next to it.
+// (Adjacency is symmetric in every direction set.)
+int BoardState::lump_n_adj_liberties(int lump, int directions)
 {
-	assert(target!=NULL);
-	vector<int> store;
-	lump_adj_liberties(target, directions, store);
-	return store.size();
+	assert(lump!=NO_LUMP);
+	if(directions==HV) return lump_liberties[lump];
+	int result=0;
+	int s=lump_stone[lump];
+	do
+	{
+		const Neighbours& n = neighbour_table[s];
+		for(const int* jj=n.begin(directions);jj!=n.end(directions);jj++)
+		{
+			if(board[*jj]!=NO_LUMP) continue;
+			bool first=true;
+			const Neighbours& m = neighbour_table[*jj];
+			for(const int* kk=m.begin(directions);kk!=m.end(directions);kk++)
+			{
+				if(*kk<s && board[*kk]==lump){first=false; break;}
+			}
+			if(first) result++;
+		}
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	return result;
 }
 
 // Return the number of liberties a move at pos would end up with, including captures.
@@ -403,144 +768,223 @@ int BoardState::lump_n_adj_liberties(Lump* target, int directions)
 int BoardState::resulting_liberties(int pos, int colour)
 {
 	assert(pos!=-1);
-	assert(board[pos]==NULL);
-	// Adjacent friends and enemies
-	vector<Lump*> adj_f;
-	adj_lumps(pos, HV, colour, adj_f);
-	vector<Lump*> adj_e;
-	adj_lumps(pos, HV, interpret_other_colour(colour), adj_e);
-	// Now make a list of all points adjacent to the resulting group
-	vector<int> adj_pts;
-	adj_points(pos, HV, adj_pts);
-	for(vector<Lump*>::iterator ii = adj_f.begin();ii!=adj_f.end();++ii)
-	{
-		if((*ii)->invincible) return 1000;
-		lump_adj_points(*ii, HV, adj_pts);
-	}
-	sort(adj_pts.begin(), adj_pts.end());
-	adj_pts.erase(unique(adj_pts.begin(), adj_pts.end()), adj_pts.end());
-	// Create a list filled with pointers that will indicate a to-be-empty space on the board
-	vector<Lump*> will_be_empty;
-	will_be_empty.push_back(NULL);
-	for(vector<Lump*>::iterator ii = adj_e.begin(); ii!=adj_e.end(); ++ii)
-	{
-		if(lump_n_adj_liberties(*ii, HV)==1 && !(*ii)->invincible) will_be_empty.push_back(*ii);
-	}
-	int result = 0;
-	for(vector<int>::iterator jj = adj_pts.begin();jj!=adj_pts.end();++jj)
-	{
-		if((*jj)==pos) continue;
-		if(find(will_be_empty.begin(), will_be_empty.end(), board[*jj])!=will_be_empty.end()) result++;
+	assert(board[pos]==NO_LUMP);
+	colour=interpret_colour(colour);
+	// Adjacent friends (which the move joins) and enemies in atari (which it captures)
+	int adj_f[4]; int n_f=0;
+	int adj_e[4]; int n_e=0;
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
+	{
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==colour)
+		{
+			if(lump_invincible[l]) return 1000;
+			adj_f[n_f++]=l;
+		} else if(lump_liberties[l]==1 && !lump_invincible[l])
+		{
+			adj_e[n_e++]=l;
+		}
 	}
-	return result;
+	// The resulting liberties are those of the friends joined, the empty points next to pos,
+	// and any captured stones next to pos or to a friend; pos itself is filled.
+	BitSet libs;
+	for(int i=0;i<n_f;i++) libs|=lump_liberty_set[adj_f[i]];
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(HV);ii!=n.end(HV);ii++)
+	{
+		if(board[*ii]==NO_LUMP) libs.set(*ii);
+	}
+	libs.reset(pos);
+	for(int i=0;i<n_e;i++)
+	{
+		int s=lump_stone[adj_e[i]];
+		do
+		{
+			const Neighbours& m = neighbour_table[s];
+			for(const int* jj=m.begin(HV);jj!=m.end(HV);jj++)
+			{
+				if(*jj==pos || (board[*jj]!=NO_LUMP && find(adj_f, adj_f+n_f, (int)board[*jj])!=adj_f+n_f))
+				{
+					libs.set(s);
+					break;
+				}
+			}
+			s=next_stone[s];
+		} while(s!=lump_stone[adj_e[i]]);
+	}
+	return libs.count();
 }
 
 // Returns true if a move at pos by colour puts anything in atari
 bool BoardState::is_atari(int pos,int colour)
 {
-	vector<Lump*> store;
-	adj_lumps(pos, HV, interpret_other_colour(colour), store);
-	for(vector<Lump*>::iterator ii=store.begin();ii!=store.end();ii++)
-	{if((*ii)->liberties==2 && (!(*ii)->invincible)) return true;}
+	colour=interpret_other_colour(colour);
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
+	{
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==colour && lump_liberties[l]==2 && !lump_invincible[l]) return true;
+	}
 	return false;
 }
 
 // Returns true if a move at pos by colour captures anything
 bool BoardState::is_capture(int pos,int colour)
 {
-	vector<Lump*> store;
-	adj_lumps(pos, HV, interpret_other_colour(colour), store);
-	for(vector<Lump*>::iterator ii=store.begin();ii!=store.end();ii++)
-	{if((*ii)->liberties==1 && (!(*ii)->invincible)) return true;}
+	colour=interpret_other_colour(colour);
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
+	{
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==colour && lump_liberties[l]==1 && !lump_invincible[l]) return true;
+	}
 	return false;
 }
-//Push onto output all the lumps on the board.
-void BoardState::all_lumps(vector<Lump*>& output)
+
+// The features of a move by colour at pos, which must be in output.points
+inline void BoardState::point_features(int pos, int colour, MoveFeatures& output)
 {
-	vector<Lump*> list_of_lumps;
-	for(int i=0;i<board_size*board_size; i++)
+	if(board[pos]!=NO_LUMP)
 	{
-		if(board[i]!=NULL){list_of_lumps.push_back(board[i]);}
+		output.resulting_liberties[pos]=0;
+		return;
 	}
-	sort(list_of_lumps.begin(), list_of_lumps.end());
-	list_of_lumps.erase(unique(list_of_lumps.begin(), list_of_lumps.end()), list_of_lumps.end());
-	for(vector<Lump*>::iterator ii=list_of_lumps.begin(); ii!=list_of_lumps.end(); ii++)
+	int libs=resulting_liberties(pos, colour);
+	output.resulting_liberties[pos]=libs;
+	if(libs>0 && !(colour==to_move && pos==ko_marker))
 	{
-		output.push_back(*ii);
+		output.legal.set(pos);
+		if(libs==1) output.self_atari.set(pos);
+	}
+	for(int i=0;i<point_cache[pos].n_lumps;i++)
+	{
+		int l = point_cache[pos].lumps[i];
+		if(lump_colour[l]==colour || lump_invincible[l]) continue;
+		if(lump_liberties[l]==1) output.capture.set(pos);
+		else if(lump_liberties[l]==2) output.atari.set(pos);
 	}
 }
 
-// Push onto output a list of pointers to lumps adjacent to pos, of given colour. 
-// Removes duplicates
-void BoardState::adj_lumps(int pos, int directions, int colour, vector<Lump*>& output)
+static void clear_features(int colour, MoveFeatures& output)
+{
+	output.colour=colour;
+	output.points.clear();
+	output.legal.clear();
+	output.capture.clear();
+	output.atari.clear();
+	output.self_atari.clear();
+}
+
+// The whole board is a run over every point. N is the board size where it is known at compile time
+// (0 where it isn't), so that run has a fixed length.
+template<int N> void BoardState::sized_move_features(int colour, MoveFeatures& output)
+{
+	const int n_points=(N ? N*N : board_size*board_size);
+	for(int pos=0;pos<n_points;pos++) output.points.set(pos);
+	for(int pos=0;pos<n_points;pos++) point_features(pos, colour, output);
+}
+
+void BoardState::move_features(int colour, MoveFeatures& output)
+{
+	colour=interpret_colour(colour);
+	clear_features(colour, output);
+	switch(board_size)
+	{
+	case 9: sized_move_features<9>(colour, output); break;
+	case 13: sized_move_features<13>(colour, output); break;
+	case 19: sized_move_features<19>(colour, output); break;
+	default: sized_move_features<0>(colour, output);
+	}
+}
+
+// Fill output with legality, resulting liberties, capture, atari and self-atari for a move by colour
+// at each point of region. Each point is looked at once: a move is legal exactly when it would
+// have some liberties (or join an invincible lump) and isn't the ko point.
+void BoardState::move_features(int colour, const BitSet& region, MoveFeatures& output)
+{
+	colour=interpret_colour(colour);
+	clear_features(colour, output);
+	output.points=region;
+	BitSet todo=region;
+	while(!todo.none())
+	{
+		int pos=todo.first();
+		todo.reset(pos);
+		point_features(pos, colour, output);
+	}
+}
+
+//Push onto output all the lumps on the board. The live list is kept up to date by play_move.
+void BoardState::all_lumps(vector<int>& output)
+{
+	output.insert(output.end(), live_lumps, live_lumps+n_lumps);
+}
+
+// Push onto output a list of lumps adjacent to pos, of given colour. 
+// Removes duplicates (HV lumps are read from the point's cached list, which has none)
+void BoardState::adj_lumps(int pos, int directions, int colour, vector<int>& output)
 {
 	assert(pos>=0);
 	colour=interpret_colour(colour);
-	vector<int> points;
-	vector<Lump*> lumps;
-	adj_points(pos, directions, points); //get list of board points adjacent.
-	for(vector<int>::iterator ii=points.begin();ii!=points.end();ii++)
-	{//fill lumps with pointers to lump objects from board
-		if(board[*ii]!=NULL){lumps.push_back(board[*ii]);}
-	} 
-	//sort, remove duplicates, erase useless end of the vector
-	sort(lumps.begin(), lumps.end());
-	lumps.erase(unique(lumps.begin(), lumps.end()), lumps.end() );
-
-	//Take resulting list of lumps, return the ones we want
-	for(vector<Lump*>::iterator ii=lumps.begin();ii!=lumps.end();ii++)
-	{
-		if((*ii)->colour==colour)
+	if(directions==HV)
+	{
+		for(int i=0;i<point_cache[pos].n_lumps;i++)
 		{
-			output.push_back(*ii); 
+			if(lump_colour[point_cache[pos].lumps[i]]==colour) output.push_back(point_cache[pos].lumps[i]);
+		}
+		return;
+	}
+	size_t start=output.size();
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
+	{
+		int l = board[*ii];
+		if(l!=NO_LUMP && lump_colour[l]==colour && find(output.begin()+start, output.end(), l)==output.end())
+		{
+			output.push_back(l);
 		}
 	}
 }
 
-// Push onto output a list of pointers to lumps adjacent to pos, of given colour and with only one liberty
+// Push onto output a list of lumps adjacent to pos, of given colour and with only one liberty
 // Removes duplicates
-void BoardState::adj_lumps_captured(int pos, int directions, int colour, vector<Lump*>& output)
+void BoardState::adj_lumps_captured(int pos, int directions, int colour, vector<int>& output)
 {
 	assert(pos>=0);
 	colour=interpret_colour(colour);
-	vector<int> points;
-	vector<Lump*> lumps;
-	adj_points(pos, directions, points); //get list of board points adjacent.
-	for(vector<int>::iterator ii=points.begin();ii!=points.end();ii++)
-	{//fill lumps with pointers to lump objects from board
-		if(board[*ii]!=NULL){lumps.push_back(board[*ii]);}
-	} 
-	//sort, remove duplicates, erase useless end of the vector
-	sort(lumps.begin(), lumps.end());
-	lumps.erase(unique(lumps.begin(), lumps.end()), lumps.end() );
-
-	//Take resulting list of lumps, return the ones we want
-	for(vector<Lump*>::iterator ii=lumps.begin();ii!=lumps.end();ii++)
-	{
-		if((*ii)->colour==colour && (*ii)->liberties==1)
+	if(directions==HV)
+	{
+		for(int i=0;i<point_cache[pos].n_lumps;i++)
 		{
-			output.push_back(*ii); 
+			int l = point_cache[pos].lumps[i];
+			if(lump_colour[l]==colour && lump_liberties[l]==1) output.push_back(l);
+		}
+		return;
+	}
+	size_t start=output.size();
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
+	{
+		int l = board[*ii];
+		if(l!=NO_LUMP && lump_colour[l]==colour && lump_liberties[l]==1 && find(output.begin()+start, output.end(), l)==output.end())
+		{
+			output.push_back(l);
 		}
 	}
 }
 
 // Push onto output a list of lumps adjacent to the given one.
 // Removes duplicates
-void BoardState::lump_adj_lumps(int pos, int directions, int colour, vector<Lump*>& output)
+void BoardState::lump_adj_lumps(int lump, int directions, int colour, vector<int>& output)
 {
-	assert(pos>=0);
-	lump_adj_lumps(board[pos], directions, colour, output);
-}
-void BoardState::lump_adj_lumps(Lump* target, int directions, int colour, vector<Lump*>& output)
-{
-	vector<Lump*> store;
-	for(vector<int>::iterator ii=target->stones.begin();ii!=target->stones.end();ii++)
+	assert(lump!=NO_LUMP);
+	size_t start=output.size();
+	int s=lump_stone[lump];
+	do
 	{
-		adj_lumps(*ii, directions, colour, store);
-	}
-	sort(store.begin(), store.end());
-	store.erase(unique(store.begin(), store.end()),store.end());
-	for(vector<Lump*>::iterator ii = store.begin();ii!=store.end();ii++){output.push_back(*ii);}
+		adj_lumps(s, directions, colour, output);
+		s=next_stone[s];
+	} while(s!=lump_stone[lump]);
+	sort(output.begin()+start, output.end());
+	output.erase(unique(output.begin()+start, output.end()),output.end());
 }
 
 // Pushes to output a list of integer board positions adjacent to pos of given colour
@@ -549,14 +993,10 @@ void BoardState::adj_lump_pos(int pos, int directions, int colour, vector<int>&
 {
 	assert(pos>=0);
 	colour=interpret_colour(colour);
-	vector<int> points;
-	adj_points(pos, directions, points); //get list of board points adjacent.
-	for(vector<int>::iterator ii=points.begin();ii!=points.end();ii++)
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
 	{
-		if(board[*ii]!=NULL)
-		{
-			if(board[*ii]->colour==colour){output.push_back(*ii);}
-		}
+		if(board[*ii]!=NO_LUMP && lump_colour[board[*ii]]==colour){output.push_back(*ii);}
 	}
 }
 
@@ -565,27 +1005,33 @@ bool BoardState::is_adj_to(int pos, int directions, int colour)
 {
 	assert(pos>=0);
 	colour=interpret_colour(colour);
-	vector<int> points;
-	adj_points(pos, directions, points); //get list of board points adjacent.
-	for(vector<int>::iterator ii=points.begin();ii!=points.end();ii++)
+	if(directions==HV)
 	{
-		if(board[*ii]!=NULL && board[*ii]->colour==colour) return true;
+		for(int i=0;i<point_cache[pos].n_lumps;i++)
+		{
+			if(lump_colour[point_cache[pos].lumps[i]]==colour) return true;
+		}
+		return false;
+	}
+	const Neighbours& n = neighbour_table[pos];
+	for(const int* ii=n.begin(directions);ii!=n.end(directions);ii++)
+	{
+		if(board[*ii]!=NO_LUMP && lump_colour[board[*ii]]==colour) return true;
 	}
 	return false;
 }
 
-
 // Returns true if target lump has any liberties inside the given box (and not in extra_border).
 // (Used in alive_in_box L&D reading)
 bool BoardState::has_libs_in_box(int target, int left, int right, int top, int bottom, std::vector<int>& extra_border)
 {
 	vector<int> store;
-	lump_adj_liberties(target, HV, store);
+	lump_adj_liberties(board[target], HV, store);
 	for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 	{
-		int x = (*ii)%board_size;
-		int y = (int)(*ii)/board_size;
+		int x = neighbour_table[*ii].x;
+		int y = neighbour_table[*ii].y;
 		if(x>left && x<right && y>top && y<bottom && find(extra_border.begin(), extra_border.end(), *ii)==extra_border.end()) return true;
 	}
 	return false;
-}
\ No newline at end of file
+}
@@ -2,50 +2,181 @@
 #define BOARD_H_300712
 
 #include <vector>
+#include <algorithm>
 #include "globals.h"
-#include "hashing.h"
-class HashObject;
+#include "bitset.h"
+class ZobristHash; // See hashing.h, which needs the sizes below
 
-class Lump
+// Largest board handled. All per-point and per-lump storage is sized for it, so that a board is
+// plain data with no heap allocation.
+const int MAX_BOARD_SIZE = 19;
+const int MAX_POINTS = MAX_BOARD_SIZE*MAX_BOARD_SIZE;
+
+// Lumps are referred to by id, an index into the lump arrays of the board. Id 0 means "no lump", so
+// board[pos]==NO_LUMP for an empty point. Every lump has a stone, so MAX_POINTS ids are always enough.
+const int NO_LUMP = 0;
+const int MAX_LUMPS = MAX_POINTS+1;
+
+// A position is also hashed as it would be after each rotation or reflection of the board, and
+// with the colours swapped, so that the hash table can treat all of these as the same position.
+// Variant v is symmetry v%N_SYMMETRIES, with colours swapped if v>=N_SYMMETRIES; variant 0 is
+// the position as it stands.
+const int N_SYMMETRIES = 8;
+const int N_HASH_VARIANTS = 2*N_SYMMETRIES;
+
+// A rectangle of points by their coordinates, edges included. Empty when left>right.
+struct Box
 {
-public:
-	Lump(int, int);
-	Lump(void){}
+	short left;
+	short right;
+	short top;
+	short bottom;
+	void clear(void){left=top=MAX_BOARD_SIZE; right=bottom=-1;}
+	bool empty(void) const {return left>right;}
+	void add(int x, int y){left=std::min<int>(left, x); right=std::max<int>(right, x); top=std::min<int>(top, y); bottom=std::max<int>(bottom, y);}
+	void add(const Box& other){if(!other.empty()){add(other.left, other.top); add(other.right, other.bottom);}}
+	bool contains(int x, int y) const {return x>=left && x<=right && y>=top && y<=bottom;}
+	bool contains(const Box& other) const {return other.empty() || (contains(other.left, other.top) && contains(other.right, other.bottom));}
+	bool meets(const Box& other) const {return !empty() && !other.empty() && other.left<=right && other.right>=left && other.top<=bottom && other.bottom>=top;}
+};
+
+// Precomputed neighbours of one point. Horizontal/vertical neighbours come first, then diagonals,
+// so that begin/end give the range for HV, DIAG or HVDIAG without any edge arithmetic.
+// The point's coordinates are kept alongside, so nothing needs pos%board_size or pos/board_size,
+// and a point is on the edge exactly when n_hv<4.
+struct Neighbours
+{
+	int points[8];
+	int n_hv;
+	int n_diag;
+	short x;
+	short y;
+	const int* begin(int directions) const {return (directions==DIAG ? points+n_hv : points);}
+	const int* end(int directions) const {return (directions==HV ? points+n_hv : points+n_hv+n_diag);}
+};
+
+// The table for a board size, built on first use and shared by everything of that size
+const Neighbours* get_neighbour_table(int board_size);
+
+// What each point's HV neighbours hold, cached so that the common adjacency queries are lookups.
+// Packed into one struct so that updating a point touches a single cache line.
+struct PointCache
+{
+	short lumps[4]; // Distinct neighbouring lumps of either colour, in increasing order
+	char count[4]; // How many neighbours belong to each of those lumps
+	char n_lumps;
+	char n_empty; // Number of empty neighbours
+};
 
-	std::vector<int> stones;
-	int index;
+// Tactical features of a move at each point for one colour, filled in by BoardState::move_features
+// in a single pass. Only the points in `points` have been looked at; anything else is unset.
+// Legality is for colour having the move: if it is not colour's turn, as if the other side had passed
+// (so the ko point is not excluded).
+struct MoveFeatures
+{
 	int colour;
-	int liberties;
+	BitSet points;
+	BitSet legal;
+	BitSet capture; // Captures something (as is_capture)
+	BitSet atari; // Puts an enemy lump in atari (as is_atari)
+	BitSet self_atari; // Legal, but leaves the stone played with one liberty
+	short resulting_liberties[MAX_POINTS]; // As resulting_liberties(); 0 for occupied points
+};
+
+// The fields of one lump, as saved by play_move before it merges or captures the lump
+struct LumpRecord
+{
+	short id;
+	short colour;
+	short size;
+	short liberties;
+	short stone;
+	short live_index;
 	bool invincible;
-	void add_stone(int);
-	int size(void){return stones.size();}
-	std::string display();
+	Box box;
 };
-		
-class BoardState
+
+// Everything play_move changes that undo_move cannot work out for itself. A stone played next to
+// friendly lumps joins the largest of them, merged[0], which keeps its id; the rest are merged into
+// it. The ids of the other merged lumps and of captured lumps are freed by play_move and handed out
+// again by undo_move in reverse order, so undoing restores the very same ids.
+struct UndoRecord
+{
+	int pos; // -1 for a pass
+	int ko_marker;
+	_int64 hash_value;
+	_int64 variant_hash[N_HASH_VARIANTS];
+	short next_stone; // Old next_stone[pos] (left over from a lump captured earlier)
+	LumpRecord merged[4];
+	BitSet merged_liberties[4]; // Liberty sets of the merged lumps (a captured lump's only liberty was pos)
+	int n_merged;
+	LumpRecord captured[4];
+	int n_captured;
+};
+
+// The position itself, as fixed-size arrays of plain data: copying one is a memcpy.
+// Lump fields are held in parallel arrays indexed by lump id.
+struct BoardData
 {
-public:
-	std::vector<Lump*> board;
-public:
-	BoardState(int); // Constructor with board size - returns empty board.
-	BoardState(const BoardState& other); // Copy constructor
-	~BoardState(void); // Destructor must delete all lump objects on the heap
 	int board_size;
 	int to_move;
-	int not_to_move(void){return interpret_other_colour(to_move);}
 	int ko_marker;
 
 	// Hash object is owned by engine. It contains the Zobrist hash values
-	// and methods to update the hash in place.
-	HashObject* hash;
-	_int32 hash_value;
+	// and methods to update the hash in place. NULL for no table (see NullHash in hashing.h).
+	ZobristHash* hash;
+	_int64 hash_value; // Covers the stones, the ko point and the side to move
+	_int64 variant_hash[N_HASH_VARIANTS]; // The same for each variant of the position (variant_hash[0]==hash_value)
+
+	const Neighbours* neighbour_table; // Shared between all boards of the same size
+	Box touched; // Covers every move played since it was last cleared (see RegionGuard in reading.cpp)
+	// The region of the innermost RegionGuard, its target, and the length of the move history when it
+	// was worked out (-1 if there is none), so that the node below can start from it
+	Box guard_region;
+	int guard_target;
+	int guard_moves;
+
+	short board[MAX_POINTS]; // Lump id at each point, or NO_LUMP
+	short next_stone[MAX_POINTS]; // The stones of each lump form a circular list through this
+
+	PointCache point_cache[MAX_POINTS]; // Kept up to date by set_point
+
+	short lump_colour[MAX_LUMPS];
+	short lump_size[MAX_LUMPS];
+	short lump_liberties[MAX_LUMPS]; // Number of liberties, always equal to lump_liberty_set[id].count()
+	BitSet lump_liberty_set[MAX_LUMPS]; // Liberties by board position, kept up to date by play_move
+	short lump_stone[MAX_LUMPS]; // The first stone placed, where the lump's stone list starts
+	Box lump_box[MAX_LUMPS]; // Smallest box holding the lump's stones
+	bool lump_invincible[MAX_LUMPS];
+
+	// Ids in use, in no particular order, and each one's place in that list
+	short live_lumps[MAX_LUMPS];
+	short live_index[MAX_LUMPS];
+	int n_lumps;
+	// Unused ids, as a stack
+	short free_ids[MAX_LUMPS];
+	int n_free;
+};
+
+class BoardState: public BoardData
+{
+public:
+	BoardState(int); // Constructor with board size - returns empty board.
+	BoardState(const BoardState& other); // Copy constructor (copies the position only; the copy starts with no move history)
+	int not_to_move(void){return interpret_other_colour(to_move);}
 
 	void display(void);
+	std::string display_lump(int lump);
 	bool is_legal_move(int);
-	int delete_lump(Lump*);
-	void merge_two_lumps(Lump& lump1, Lump& lump2);
-	int recalculate_liberties(Lump& lump);
+	int add_lump(const std::vector<int>& stones, int colour, bool invincible); // Put a lump straight onto empty points (not undoable)
+	void merge_two_lumps(int lump1, int lump2);
+	int recalculate_liberties(int lump);
 	void play_move(int);
+	void undo_move(void); // Take back the last move played (which may be a pass)
+	void clear_ko(void); // Forget the ko point (keeping the hash in step)
+
+	// One record per move played on this board, so that searches can play and undo in place
+	std::vector<UndoRecord> history;
 	
 	// Utility functions
 	// Returns colour relative to board state
@@ -53,31 +184,39 @@ public:
 	int interpret_other_colour(int colour);
 
 	// A mountain of functions that return data about the board position
-	int colour(int pos){if(board[pos]==NULL){return -1;}else{return board[pos]->colour;}}
-	int liberties(int pos){return board[pos]->liberties;}
+	int colour(int pos){if(board[pos]==NO_LUMP){return -1;}else{return lump_colour[board[pos]];}}
+	int liberties(int pos){return lump_liberties[board[pos]];}
+	bool is_invincible(int pos){return board[pos]!=NO_LUMP && lump_invincible[board[pos]];}
+	void lump_stones(int lump, std::vector<int>& output);
 
 	void taxicab_radius(int pos, int r, std::vector<int>& output);
-	void taxicab_radius_lumps(int pos, int r, std::vector<Lump*>& output);
+	void taxicab_radius_lumps(int pos, int r, std::vector<int>& output);
+
+	// Allocation-free neighbour iteration:
+	// for(const int* ii=b.neighbours(pos).begin(HV);ii!=b.neighbours(pos).end(HV);ii++)
+	const Neighbours& neighbours(int pos){return neighbour_table[pos];}
 
 	void adj_points(int pos, int directions, std::vector<int>& output);
 	void adj_liberties(int pos, int directions, std::vector<int>& output);
 	int n_adj_liberties(int pos, int directions);
-	void lump_adj_points(Lump* target, int directions, std::vector<int>& output);
-	void lump_adj_points(int pos, int directions, std::vector<int>& output);
-	void lump_adj_liberties(Lump* target, int directions, std::vector<int>& output);
-	void lump_adj_liberties(int pos, int directions, std::vector<int>& output);
 
-	int lump_n_adj_liberties(int pos, int directions);
-	int lump_n_adj_liberties(Lump* target, int directions);
+	// Functions taking a lump take its id (use board[pos] for the lump at pos)
+	void lump_adj_points(int lump, int directions, std::vector<int>& output);
+	void lump_adj_liberties(int lump, int directions, std::vector<int>& output);
+	int lump_n_adj_liberties(int lump, int directions);
 	int resulting_liberties(int pos, int colour);
 	bool is_atari(int pos, int colour);
 	bool is_capture(int pos, int colour);
 
-	void all_lumps(std::vector<Lump*>& output);
-	void adj_lumps(int pos, int directions, int colour, std::vector<Lump*>& output);
-	void adj_lumps_captured(int pos, int directions, int colour, std::vector<Lump*>& output);
-	void lump_adj_lumps(int pos, int directions, int colour, std::vector<Lump*>& output);
-	void lump_adj_lumps(Lump* target, int directions, int colour, std::vector<Lump*>& output);
+	// The same answers for many points at once: over the whole board, or just the points in region
+	void move_features(int colour, MoveFeatures& output);
+	void move_features(int colour, const BitSet& region, MoveFeatures& output);
+
+	// These output lump ids
+	void all_lumps(std::vector<int>& output);
+	void adj_lumps(int pos, int directions, int colour, std::vector<int>& output);
+	void adj_lumps_captured(int pos, int directions, int colour, std::vector<int>& output);
+	void lump_adj_lumps(int lump, int directions, int colour, std::vector<int>& output);
 	void adj_lump_pos(int pos, int directions, int colour, std::vector<int>& output);
 
 	bool is_adj_to(int pos, int directions, int colour);
@@ -86,9 +225,34 @@ public:
 
 private:
 	BoardState& operator=(const BoardState&); // No assignment operator
+	template<class Hash> void play_move(Hash& h, int pos); // play_move with the board's hash policy
+	template<class Hash> int remove_lump(Hash& h, int lump);
+	template<int N> void sized_move_features(int colour, MoveFeatures& output);
+	void point_features(int pos, int colour, MoveFeatures& output);
+	int new_lump(int pos, int colour);
+	void free_lump(int lump);
+	void extend_lump(int lump, int pos);
+	void set_point(int pos, int lump);
+	void save_lump(int lump, LumpRecord& record);
+	void restore_lump(const LumpRecord& record);
+	void add_liberty(int pos, int colour);
+	void remove_liberty(int pos, int colour);
 	
 };//class board_state
 
+// Undoes, when it goes out of scope, every move played on b since it was created.
+// Lets a reading function play moves in place and still return from anywhere.
+class UndoGuard
+{
+public:
+	UndoGuard(BoardState& b):board(b), start(b.history.size()){}
+	~UndoGuard(){while(board.history.size()>start) board.undo_move();}
+private:
+	BoardState& board;
+	size_t start;
+	UndoGuard& operator=(const UndoGuard&);
+};
+
 
 
 
@@ -10,11 +10,15 @@
 using namespace std;
 
 // Engine method that returns true if two lumps are tactically connected
-bool TLGETC::is_connected(Lump* lump1, Lump* lump2, ReadingSettings settings, ReadingLog& log)
+bool TLGETC::is_connected(int lump1, int lump2, ReadingSettings settings, ReadingLog& log)
 {
 	log.addline("Determining connection between ");
-	log.addpos(lump1->stones[0]); log.add(" and ");log.addpos(lump2->stones[0]);
-	if(lump1->liberties==1 || lump2->liberties==1) return false;
+	log.addpos(b.lump_stone[lump1]); log.add(" and ");log.addpos(b.lump_stone[lump2]);
+	if(b.lump_liberties[lump1]==1 || b.lump_liberties[lump2]==1) return false;
+	// Moves played below can free lump1's id and hand it to another lump, so keep its colour
+	int colour1=b.lump_colour[lump1];
+	// The opponent's moves, from make_move (the board is back in the same position for every pair)
+	const MoveFeatures& enemy_moves=features[b.interpret_other_colour(colour1)];
 	int l1=lump_data.find(lump1)->second.left; int l2=lump_data.find(lump2)->second.left;
 	int r1=lump_data.find(lump1)->second.right; int r2=lump_data.find(lump2)->second.right;
 	int t1=lump_data.find(lump1)->second.top; int t2=lump_data.find(lump2)->second.top;
@@ -35,56 +39,60 @@ bool TLGETC::is_connected(Lump* lump1, Lump* lump2, ReadingSettings settings, Re
 	if(shared_libs.size()>=2) return true;
 	// If we have one shared liberty, quick check: is this playing one stone into hanging connection?
 	if(shared_libs.size()==1 && (b.n_adj_liberties(shared_libs[0], HV)<=1) 
-		&& !b.is_adj_to(shared_libs[0], HV, b.interpret_other_colour(lump1->colour))
-		&& !b.is_capture(shared_libs[0], b.interpret_other_colour(lump1->colour))) return true;
+		&& !b.is_adj_to(shared_libs[0], HV, b.interpret_other_colour(colour1))
+		&& !enemy_moves.capture.test(shared_libs[0])) return true;
 
 	// Now see if the lumps share any common enemy groups that can be captured
-	vector<Lump*> store2;
-	vector<Lump*> shared_lumps;
-	b.lump_adj_lumps(lump1, HV, b.interpret_other_colour(lump1->colour), store2);
-	b.lump_adj_lumps(lump2, HV, b.interpret_other_colour(lump1->colour), store2);
+	vector<int> store2;
+	vector<int> shared_lumps;
+	b.lump_adj_lumps(lump1, HV, b.interpret_other_colour(colour1), store2);
+	b.lump_adj_lumps(lump2, HV, b.interpret_other_colour(colour1), store2);
 	sort(store2.begin(), store2.end());
-	vector<Lump*>::iterator jj = adjacent_find(store2.begin(), store2.end());
+	vector<int>::iterator jj = adjacent_find(store2.begin(), store2.end());
 	while(jj!=store2.end())
 	{
-		int status = get_status(b, (*jj)->stones[0], true, NULL, NULL, settings, log);
+		int status = get_status(b, b.lump_stone[*jj], true, NULL, NULL, settings, log);
 		if(status==DEAD) return true;
 		if(status==UNSETTLED) shared_lumps.push_back(*jj);
 		jj=adjacent_find(jj+1, store2.end());
 	}
 	if(shared_lumps.size() + shared_libs.size() >=2) return true;
 
-	// If we have one cutting point, check whether it's capturable
+	// If we have one cutting point, check whether it's capturable.
+	// This reads in place on the engine's board; every move played is undone before returning.
 	if(shared_libs.size()==1)
 	{
 		int sl=shared_libs[0];
-		BoardState b_copy=b;
-		if(b_copy.to_move==lump1->colour) b_copy.play_move(-1);
-		if(b_copy.is_legal_move(sl))
+		// Colours before anything is played, for the one-point jump test below
+		vector<int> colour_before(b.board_size*b.board_size);
+		for(int i=0;i<b.board_size*b.board_size;i++) colour_before[i]=b.colour(i);
+		if(enemy_moves.legal.test(sl))
 		{
-			b_copy.play_move(sl);
-			if(get_capturable(b_copy, sl, -1, settings, log)) return true;
+			UndoGuard guard(b);
+			if(b.to_move==colour1) b.play_move(-1);
+			b.play_move(sl);
+			if(get_capturable(b, sl, -1, settings, log)) return true;
 			// So not capturable.
 			// Now test for one-point jump connection
 			// If not on edge...
-			if(sl>=b_copy.board_size && sl<(b_copy.board_size * (b_copy.board_size-1))&& sl%b_copy.board_size != 0 && sl%b_copy.board_size != b_copy.board_size-1)
+			if(b.neighbours(sl).n_hv==4)
 			{
 				vector<int> store;
 				store.clear();
-				b_copy.adj_liberties(sl, HV, store);
+				b.adj_liberties(sl, HV, store);
 				// We have pushed; now try blocking each side
 				for(vector<int>::iterator ii = store.begin();ii!=store.end();ii++)
 				{
-					if(b_copy.is_legal_move(*ii))
+					if(b.is_legal_move(*ii))
 					{
-						BoardState b_copy2 = b_copy;
-						b_copy2.play_move(*ii);
+						UndoGuard block_guard(b);
+						b.play_move(*ii);
 						// We have pushed and blocked; now compute two diagonal moves
 						int m1, m2;
 						if((*ii)-sl==1 || (*ii)-sl==-1)
 						{
-							m1=(*ii)-b_copy2.board_size;
-							m2=(*ii)+b_copy2.board_size;
+							m1=(*ii)-b.board_size;
+							m2=(*ii)+b.board_size;
 						} else {
 							m1=(*ii)-1;
 							m2=(*ii)+1;
@@ -97,38 +105,42 @@ bool TLGETC::is_connected(Lump* lump1, Lump* lump2, ReadingSettings settings, Re
 						//   capturing/defending m2 and letting m1 die)
 						// Repeat with m1, m2 reversed.
 						vector<int> escs;
-						int status = get_status(b_copy2, sl, true, NULL, &escs, settings, log);
+						int status = get_status(b, sl, true, NULL, &escs, settings, log);
 						if(status==UNSETTLED)
 						{
-							if(b.colour(m1)==lump1->colour || b.colour(m2)==lump1->colour) return true;
+							if(colour_before[m1]==colour1 || colour_before[m2]==colour1) return true;
 							// We only try escs[0]; could try all of them if we're less lazy
-							b_copy2.play_move(escs[0]);							
-							if(get_capturable(b_copy2, m1, b_copy2.colour(sl), settings, log)) return true;
-							if(get_capturable(b_copy2, m2, b_copy2.colour(sl), settings, log)) return true;
+							b.play_move(escs[0]);
+							if(get_capturable(b, m1, b.colour(sl), settings, log)) return true;
+							if(get_capturable(b, m2, b.colour(sl), settings, log)) return true;
 						}
 						if(status==ALIVE)
 						{
-							if(b_copy2.is_legal_move(m1))
+							if(b.is_legal_move(m1))
 							{
-								BoardState bc3 = b_copy2;
-								bc3.play_move(m1);
-								if(bc3.is_legal_move(m2)) bc3.play_move(m2);
-								else bc3.play_move(-1);
-								if(get_status(bc3, m1, true, NULL, NULL, settings, log)==DEAD
-									&& get_capturable(b_copy2, m2, b_copy2.colour(sl), settings, log)) return true;
+								b.play_move(m1);
+								if(b.is_legal_move(m2)) b.play_move(m2);
+								else b.play_move(-1);
+								int m1_status = get_status(b, m1, true, NULL, NULL, settings, log);
+								b.undo_move();
+								b.undo_move();
+								if(m1_status==DEAD
+									&& get_capturable(b, m2, b.colour(sl), settings, log)) return true;
 							} else {
-								if(get_capturable(b_copy2, m2, b_copy2.colour(sl), settings, log)) return true;
+								if(get_capturable(b, m2, b.colour(sl), settings, log)) return true;
 							}
-							if(b_copy2.is_legal_move(m2))
+							if(b.is_legal_move(m2))
 							{
-								BoardState bc4 = b_copy2;
-								bc4.play_move(m2);
-								if(bc4.is_legal_move(m1)) bc4.play_move(m1);
-								else bc4.play_move(-1);
-								if(get_status(bc4, m2, true, NULL, NULL, settings, log)==DEAD
-									&& get_capturable(b_copy2, m1, b_copy2.colour(sl), settings, log)) return true;
+								b.play_move(m2);
+								if(b.is_legal_move(m1)) b.play_move(m1);
+								else b.play_move(-1);
+								int m2_status = get_status(b, m2, true, NULL, NULL, settings, log);
+								b.undo_move();
+								b.undo_move();
+								if(m2_status==DEAD
+									&& get_capturable(b, m1, b.colour(sl), settings, log)) return true;
 							} else {
-								if(get_capturable(b_copy2, m1, b_copy2.colour(sl), settings, log)) return true;
+								if(get_capturable(b, m1, b.colour(sl), settings, log)) return true;
 							}
 						}
 
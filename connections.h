@@ -7,11 +7,11 @@
 /*class Connection
 {
 public:
-	Connection(Lump* f, Lump* s):first(f), second(s)
+	Connection(int f, int s):first(f), second(s)
 	{
 	}
-	Lump* first;
-	Lump* second;
+	int first;
+	int second;
 };
 */
 
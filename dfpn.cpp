@@ -0,0 +1,237 @@
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "board.h"
+#include "globals.h"
+#include "hashing.h"
+#include "reading.h"
+#include "dfpn.h"
+
+using namespace std;
+
+// Depth-first proof-number search (df-pn). The attacker wins by capturing the target; the defender
+// wins once the target has escape_libs liberties on its turn, or when the attacker has no moves left. Each side
+// has the moves the fixed-depth reader would give it (capture_moves and escape_moves), all of them
+// rather than the first branch_limit, and there is no depth limit: the search goes wherever the
+// proof and disproof numbers say an answer is cheapest, so a narrow fight is followed to its end.
+//
+// Numbers are kept from the side of the player to move: phi is the work left to show that it wins,
+// delta the work to show that it loses. A node's phi is the smallest delta of its children and its
+// delta the sum of their phis. The table holds them as the attacker's proof and disproof numbers.
+//
+// A move that repeats a position from earlier in the read (a ko fight going round) wins for the
+// defender, who could keep it up for ever, as in read_ladder. That result only holds on the path
+// that led to it, so an answer settled by one is passed back up the search but never stored.
+
+template<class Hash> class Dfpn
+{
+public:
+	Dfpn(BoardState& b, Hash& h, int target, ReadingSettings& settings, ReadingLog& log);
+	ReadResult solve(void);
+private:
+	// A move from the node being searched, and what is known about the position it leads to
+	struct Child
+	{
+		int move;
+		int phi;
+		int delta;
+		int hash_move; // The table's best move in that position
+		bool path_dependent;
+	};
+	BoardState& b;
+	Hash& hash;
+	int target;
+	int target_colour;
+	ReadingSettings& settings;
+	ReadingLog& log;
+	size_t start; // History length when the read started
+	int node_limit;
+	bool gave_up;
+	bool attacker_to_move(void){return b.to_move!=target_colour;}
+	bool out_of_nodes(void){return gave_up || log.stopped;}
+	void evaluate(Child& c);
+	void mid(Child& node, int th_phi, int th_delta);
+	void store(const Child& node, int move, int nodes);
+	Dfpn& operator=(const Dfpn&);
+};
+
+// Numbers for a position whose winner is known: the side to move wins or loses
+static void settle(int& phi, int& delta, bool mover_wins)
+{
+	phi=(mover_wins ? 0 : PROOF_INFINITY);
+	delta=(mover_wins ? PROOF_INFINITY : 0);
+}
+
+template<class Hash> Dfpn<Hash>::Dfpn(BoardState& board, Hash& h, int t, ReadingSettings& s, ReadingLog& l):
+	b(board), hash(h), target(t), target_colour(board.colour(t)), settings(s), log(l)
+{
+	start=b.history.size();
+	node_limit=log.total_moves+(settings.node_budget!=0 ? settings.node_budget : DFPN_NODE_LIMIT);
+	gave_up=false;
+}
+
+// What is known about the position on b without searching it: the result if the rules settle it,
+// otherwise the table's numbers, otherwise a first guess from the target's liberties
+template<class Hash> void Dfpn<Hash>::evaluate(Child& c)
+{
+	bool attacker=attacker_to_move();
+	c.path_dependent=false;
+	c.hash_move=-1;
+	if(b.board[target]==NO_LUMP)
+	{
+		settle(c.phi, c.delta, attacker);
+		return;
+	}
+	// The attacker's move takes at most one liberty, so with the attacker to move it takes one more to escape
+	int libs=b.liberties(target);
+	if(b.is_invincible(target) || libs>=settings.escape_libs+(attacker ? 1 : 0))
+	{
+		settle(c.phi, c.delta, !attacker);
+		return;
+	}
+	if(attacker && libs==1)
+	{
+		settle(c.phi, c.delta, true);
+		return;
+	}
+	if(is_repetition(b, start))
+	{
+		settle(c.phi, c.delta, !attacker);
+		c.path_dependent=true;
+		return;
+	}
+	ProofNumbers known;
+	if(hash.query_proof(b, target, known))
+	{
+		c.phi=(attacker ? known.proof : known.disproof);
+		c.delta=(attacker ? known.disproof : known.proof);
+		c.hash_move=known.move;
+		return;
+	}
+	// Each liberty is roughly one more attacking move to prove the capture
+	int proof=max(1, libs-1);
+	c.phi=(attacker ? proof : 1);
+	c.delta=(attacker ? 1 : proof);
+}
+
+template<class Hash> void Dfpn<Hash>::store(const Child& node, int move, int nodes)
+{
+	ProofNumbers numbers;
+	bool attacker=attacker_to_move();
+	numbers.proof=(attacker ? node.phi : node.delta);
+	numbers.disproof=(attacker ? node.delta : node.phi);
+	numbers.move=move;
+	numbers.effort=0;
+	while(numbers.effort<30 && (1<<numbers.effort)<=nodes) numbers.effort++;
+	hash.insert_proof(b, target, numbers);
+}
+
+// Search the position on b until its phi reaches th_phi or its delta th_delta, or it is settled
+template<class Hash> void Dfpn<Hash>::mid(Child& node, int th_phi, int th_delta)
+{
+	int first_node=log.total_moves;
+	log.total_moves++;
+	if(log.out_of_budget() || log.total_moves>=node_limit)
+	{
+		gave_up=true;
+		return;
+	}
+	bool attacker=attacker_to_move();
+	int libs=b.liberties(target);
+	if((attacker && libs==2 && is_ladderable(b, target, NULL, log)) || (!attacker && libs==1 && is_laddered(b, target, log)))
+	{
+		settle(node.phi, node.delta, attacker);
+		node.path_dependent=false;
+		store(node, -1, 1);
+		return;
+	}
+
+	// As a depth, escape_libs makes capture_moves insist on a liberty only if the defender would escape by taking it
+	vector<int> moves;
+	if(attacker) capture_moves(b, target, settings.escape_libs, moves, log);
+	else escape_moves(b, target, settings.escape_libs, moves, log);
+	vector<int>::iterator first=find(moves.begin(), moves.end(), node.hash_move);
+	if(first!=moves.end()) rotate(moves.begin(), first, first+1);
+	vector<Child> children(moves.size());
+	for(size_t i=0;i<moves.size();i++)
+	{
+		children[i].move=moves[i];
+		b.play_move(moves[i]);
+		evaluate(children[i]);
+		b.undo_move();
+	}
+
+	int best=-1;
+	while(true)
+	{
+		// With no moves, the side to move loses
+		node.phi=PROOF_INFINITY;
+		node.delta=0;
+		int second_delta=PROOF_INFINITY;
+		best=-1;
+		bool any_path_dependent=false;
+		for(size_t i=0;i<children.size();i++)
+		{
+			const Child& c=children[i];
+			// Ties go to a result that holds on any path, then to the earlier move
+			if(best==-1 || c.delta<children[best].delta || (c.delta==0 && children[best].path_dependent && !c.path_dependent))
+			{
+				if(best!=-1) second_delta=min(second_delta, children[best].delta);
+				best=(int)i;
+			} else {
+				second_delta=min(second_delta, c.delta);
+			}
+			node.delta=(c.phi==PROOF_INFINITY || node.delta==PROOF_INFINITY ? PROOF_INFINITY : min(node.delta+c.phi, PROOF_INFINITY-1));
+			any_path_dependent=any_path_dependent || c.path_dependent;
+		}
+		if(best!=-1) node.phi=children[best].delta;
+		node.path_dependent=(node.phi==0 ? children[best].path_dependent : node.delta==0 && any_path_dependent);
+		if(node.phi>=th_phi || node.delta>=th_delta) break;
+
+		Child& c=children[best];
+		int child_th_phi=min(th_delta-node.delta+c.phi, PROOF_INFINITY);
+		int child_th_delta=min(th_phi, second_delta+1);
+		b.play_move(c.move);
+		log.current_depth++;
+		mid(c, child_th_phi, child_th_delta);
+		log.current_depth--;
+		b.undo_move();
+		if(out_of_nodes()) return;
+	}
+	if(!node.path_dependent) store(node, best==-1 ? -1 : children[best].move, log.total_moves-first_node);
+}
+
+template<class Hash> ReadResult Dfpn<Hash>::solve(void)
+{
+	Child root;
+	root.move=-1;
+	evaluate(root);
+	if(root.phi!=0 && root.delta!=0) mid(root, PROOF_INFINITY, PROOF_INFINITY);
+	ReadResult out;
+	out.depth=0;
+	out.proven=(root.phi==0 || root.delta==0) && !out_of_nodes();
+	// The attacker wins if it is to move and wins, or the defender is to move and loses
+	out.status=(out.proven && (attacker_to_move() ? root.phi==0 : root.delta==0) ? DEAD : ALIVE);
+	if(!out.proven && !log.stopped) log.unproven++;
+	return out;
+}
+
+static ReadResult dfpn(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(b.board[target]!=NO_LUMP);
+	if(b.hash!=NULL) return Dfpn<ZobristHash>(b, *b.hash, target, settings, log).solve();
+	NullHash no_table;
+	return Dfpn<NullHash>(b, no_table, target, settings, log).solve();
+}
+
+ReadResult dfpn_capture(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(b.to_move!=b.colour(target));
+	return dfpn(b, target, settings, log);
+}
+
+ReadResult dfpn_escape(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(b.to_move==b.colour(target));
+	return dfpn(b, target, settings, log);
+}
@@ -0,0 +1,17 @@
+#ifndef DFPN_H_300712
+#define DFPN_H_300712
+
+#include "board.h"
+#include "reading.h"
+
+// Depth-first proof-number search for the questions the fixed-depth reader answers: can_capture
+// (dfpn_capture, with the attacker to move) and can_escape (dfpn_escape, with the target's side to
+// move). Pick it with settings.solver=DFPN_SOLVER; get_status and get_capturable then use it.
+// The answer is DEAD if the target can be captured, ALIVE if not. It is not proven if the solver ran
+// out of nodes (settings.node_budget for each read, or DFPN_NODE_LIMIT if there is none) or time,
+// and then the answer is ALIVE.
+const int DFPN_NODE_LIMIT = 20000;
+ReadResult dfpn_capture(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log);
+ReadResult dfpn_escape(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log);
+
+#endif
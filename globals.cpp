@@ -16,8 +16,6 @@ const int ALIVE = 0;
 const int DEAD = 1;
 const int UNSETTLED = 2;
 
-const int DEBUG_BS = 9; //Board size, for debugging only!
-
 bool vectors_intersect(std::vector<int> vec0, std::vector<int> vec1)
 {
 	for(std::vector<int>::iterator ii = vec0.begin();ii!=vec0.end();ii++)
@@ -5,7 +5,6 @@
 #include <algorithm>
 #include <string>
 
-#include "board.h"
 #include <assert.h>
 
 extern const int BLACK;
@@ -21,7 +20,8 @@ extern const int ALIVE;
 extern const int DEAD;
 extern const int UNSETTLED;
 
-extern const int DEBUG_BS;
+// board.h uses the direction constants above, so it is included after them
+#include "board.h"
 
 
 bool vectors_intersect(std::vector<int> vec0, std::vector<int> vec1); // THIS IS SO BAD! WHAT WERE YOU THINKING?
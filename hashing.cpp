@@ -1,12 +1,26 @@
 #include <vector>
-#include <unordered_map>
+#include <new>
 #include "hashing.h"
 #include <cstdlib>
 #include <iostream>
 #include <algorithm>
 #include <ctime>
+#include <assert.h>
+#include <string.h>
 #include "board.h"
 #include "globals.h"
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -17,11 +31,22 @@ using namespace std;
 
 // Invincible stones not treated differently
 
-// Hash table has 64-bit entry: 
-// 32 bits for board position
-// 9 bits for the target of the function call
-// 1 bit for can_capture / can_escape
-// = 42 bits total
+// The position's hash value is 64 bits: the stones, the ko point and the side to move each
+// contribute a Zobrist value. The key of a query is that, XORed with the values of every stone of
+// the target lump (so any stone of the lump asks the same question) and a value for can_capture
+// (as against can_escape).
+
+// A query can instead be limited to a region (a box around the target): then the stones outside the
+// box and the ring of points around it are left out of its key, so the result is found again after
+// moves elsewhere on the board. It is for the reader to make sure that the result depended on nothing
+// else (see RegionGuard in reading.cpp). Region keys also take in the box itself.
+
+// Tactics do not change when the board is turned or reflected, or when the colours are swapped
+// along with the side to move, so the table is keyed on a canonical form of the query. The board
+// keeps the hash of each variant of the position up to date (see board.h). The variant whose
+// position key is lowest picks the bucket and the key (the lowest query key among them, should the
+// position be symmetric). Moves stored with an entry are turned the same way, and turned back
+// when they are read.
 
 // A can_capture=true or can_escape=false is always correct
 // If can_capture=false or can_escape=true, we might have just exceeded depth limit
@@ -32,94 +57,826 @@ using namespace std;
 // If the result is "not captured", the search depth is stored (because this result
 // might have been caused by running out of depth, and so might be wrong).
 
+// The table is a fixed number of buckets, chosen from a memory budget, so a long session does not
+// grow it. A bucket is picked by the position's hash value alone (the target and query type only
+// tell entries apart within it), so play_move can prefetch the bucket before the position is looked up.
+// A region query picks its bucket by the region's key in the same way.
+// When a bucket is full, a deep result pushes the shallowest of the depth-preferred entries into the
+// always-replace slot; anything shallower just overwrites that slot.
+// An entry holds its whole key, so beyond the bits used to pick the bucket there are 64-log2(buckets)
+// bits checking that it is the same query: at least 40 even for a table of millions of entries.
+// Slots are read and written with relaxed atomic loads and stores, which cost no more than plain ones
+// on x86; a slot torn by two threads storing at once fails its check and is treated as a miss.
+
+
+// The Zobrist values for every point of the largest board: black stones, white stones, ko points and
+// targets, then one for White to move and one for can_capture, then the edges of regions, then one
+// for df-pn entries and one for each order of lambda search. They are
+// built once per run from a fixed seed, so that every hash object (of any board size) shares them,
+// creating one costs nothing, and the global rand() sequence is left alone. The generator is
+// splitmix64. Tables kept in files record the seed, since their keys are only good for the same values.
+const int N_ZOBRIST_VALUES = 4*MAX_POINTS+2+4*MAX_BOARD_SIZE+1+MAX_LAMBDA_ORDER;
+const _int64 ZOBRIST_SEED = 0;
+static bool fill_zobrist_values(_int64* values)
+{
+	unsigned long long state=ZOBRIST_SEED;
+	for(int i=0;i<N_ZOBRIST_VALUES;i++)
+	{
+		state+=0x9E3779B97F4A7C15ULL;
+		unsigned long long z=state;
+		z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+		z=(z^(z>>27))*0x94D049BB133111EBULL;
+		values[i]=(_int64)(z^(z>>31));
+	}
+	return true;
+}
+const _int64* zobrist_values(void)
+{
+	static _int64 values[N_ZOBRIST_VALUES];
+	static bool filled=fill_zobrist_values(values); // Only once, even with several threads starting at the same time
+	(void)filled;
+	return values;
+}
+
+// Largest power of two number of buckets within the budget
+static size_t buckets_in_budget(int megabytes)
+{
+	size_t n_buckets=1;
+	while(n_buckets*2*sizeof(HashBucket) <= (size_t)megabytes*1024*1024) n_buckets*=2;
+	return n_buckets;
+}
+
+ZobristHash::ZobristHash(int board_size, int megabytes)
+{
+	this->board_size=board_size;
+	black_values=zobrist_values();
+	white_values=zobrist_values()+MAX_POINTS;
+	ko_values=zobrist_values()+2*MAX_POINTS;
+	target_values=zobrist_values()+3*MAX_POINTS;
+	white_to_move_value=zobrist_values()[4*MAX_POINTS];
+	capture_query_value=zobrist_values()[4*MAX_POINTS+1];
+	box_values=zobrist_values()+4*MAX_POINTS+2;
+	proof_query_value=zobrist_values()[4*MAX_POINTS+2+4*MAX_BOARD_SIZE];
+	lambda_query_values=zobrist_values()+4*MAX_POINTS+2+4*MAX_BOARD_SIZE+1;
+
+	// The symmetries of this board, as (x,y) -> (x,y), (n-x,y), (x,n-y), (n-x,n-y), (y,x), (n-y,x),
+	// (y,n-x), (n-y,n-x), where n=board_size-1
+	int n_points=board_size*board_size;
+	int n=board_size-1;
+	for(int t=0;t<N_SYMMETRIES;t++)
+	{
+		symmetry[t].resize(n_points);
+		inverse_symmetry[t].resize(n_points);
+		for(int pos=0;pos<n_points;pos++)
+		{
+			int x=pos%board_size, y=pos/board_size;
+			if(t>=4) swap(x, y);
+			if(t&1) x=n-x;
+			if(t&2) y=n-y;
+			symmetry[t][pos]=x+board_size*y;
+			inverse_symmetry[t][x+board_size*y]=pos;
+		}
+	}
+	variant_stone_values.resize(n_points*2*N_HASH_VARIANTS);
+	variant_ko_values.resize(n_points*N_HASH_VARIANTS);
+	variant_target_values.resize(n_points*N_HASH_VARIANTS);
+	for(int pos=0;pos<n_points;pos++)
+	{
+		for(int v=0;v<N_HASH_VARIANTS;v++)
+		{
+			int image=symmetry[v%N_SYMMETRIES][pos];
+			bool swapped=v>=N_SYMMETRIES;
+			variant_stone_values[(pos*2+BLACK)*N_HASH_VARIANTS+v]=(swapped ? white_values : black_values)[image];
+			variant_stone_values[(pos*2+WHITE)*N_HASH_VARIANTS+v]=(swapped ? black_values : white_values)[image];
+			variant_ko_values[pos*N_HASH_VARIANTS+v]=ko_values[image];
+			variant_target_values[pos*N_HASH_VARIANTS+v]=target_values[image];
+		}
+	}
+
+	mapping=NULL;
+	mapping_bytes=0;
+	generation=0;
+	size_t n_buckets=buckets_in_budget(megabytes);
+	bucket_mask=(unsigned _int32)(n_buckets-1);
+	storage.resize(n_buckets*sizeof(HashBucket)+CACHE_LINE);
+	size_t offset=(CACHE_LINE-(size_t)&storage[0]%CACHE_LINE)%CACHE_LINE;
+	buckets=(HashBucket*)&storage[offset];
+	for(size_t i=0;i<n_buckets;i++) new (&buckets[i]) HashBucket();
+	clear();
+}
+
+// Empty every slot. The memory stays allocated.
+void ZobristHash::clear(void)
+{
+	for(unsigned _int32 i=0;i<=bucket_mask;i++)
+	{
+		for(int j=0;j<BUCKET_SLOTS;j++)
+		{
+			buckets[i].slot[j].check.store(0, memory_order_relaxed);
+			buckets[i].slot[j].data.store(0, memory_order_relaxed);
+		}
+	}
+	reset_counters();
+}
+
+// Table files. The file is locked while its header is checked or written, so that processes
+// opening it at the same moment do not both set it up. After that, the lock-free slots are
+// shared between processes just as they are between threads.
+
+// Open filename (creating it if needed), lock it, and map all of it, growing it to bytes first if it
+// is empty. bytes is set to the size mapped. Returns NULL on failure; otherwise the file stays locked
+// until unlock_file(lock).
+static void* map_locked_file(const string& filename, size_t& bytes, void*& lock)
+{
+	void* p=NULL;
+#ifdef _WIN32
+	HANDLE file=CreateFileA(filename.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file==INVALID_HANDLE_VALUE) return NULL;
+	OVERLAPPED whole;
+	ZeroMemory(&whole, sizeof(whole));
+	LARGE_INTEGER size;
+	if(!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole) || !GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+	if(size.QuadPart!=0) bytes=(size_t)size.QuadPart;
+	// Mapping more than the file holds grows it, with zeros
+	HANDLE map=CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((unsigned _int64)bytes>>32), (DWORD)bytes, NULL);
+	if(map!=NULL)
+	{
+		p=MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+		CloseHandle(map); // The view keeps the mapping alive
+	}
+	if(p==NULL)
+	{
+		UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &whole);
+		CloseHandle(file);
+		return NULL;
+	}
+	lock=file;
+#else
+	int fd=open(filename.c_str(), O_RDWR|O_CREAT, 0644);
+	if(fd<0) return NULL;
+	struct stat st;
+	if(flock(fd, LOCK_EX)!=0 || fstat(fd, &st)!=0 || (st.st_size==0 && ftruncate(fd, bytes)!=0))
+	{
+		close(fd);
+		return NULL;
+	}
+	if(st.st_size!=0) bytes=(size_t)st.st_size;
+	p=mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p==MAP_FAILED)
+	{
+		close(fd); // Also drops the lock
+		return NULL;
+	}
+	lock=(void*)(size_t)fd;
+#endif
+	return p;
+}
+
+static void unlock_file(void* lock)
+{
+#ifdef _WIN32
+	OVERLAPPED whole;
+	ZeroMemory(&whole, sizeof(whole));
+	UnlockFileEx((HANDLE)lock, 0, MAXDWORD, MAXDWORD, &whole);
+	CloseHandle((HANDLE)lock);
+#else
+	close((int)(size_t)lock); // The mapping stays; closing drops the lock
+#endif
+}
+
+static void unmap_file(void* p, size_t bytes)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(p);
+#else
+	munmap(p, bytes);
+#endif
+}
+
+// Fails to compile if the header would put the buckets off their cache-line alignment
+typedef char header_size_check[sizeof(HashFileHeader)==CACHE_LINE ? 1 : -1];
+
+// What the header of a file holding n_buckets buckets should say
+HashFileHeader ZobristHash::file_header(size_t n_buckets)
+{
+	HashFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TLGETCtt", 8);
+	header.version=HASH_FILE_VERSION;
+	header.board_size=board_size;
+	header.key_seed=ZOBRIST_SEED;
+	header.bucket_slots=BUCKET_SLOTS;
+	header.entry_bytes=sizeof(HashEntry);
+	header.n_buckets=n_buckets;
+	return header;
+}
+
+bool ZobristHash::open_file(const string& filename, int megabytes)
+{
+	size_t n_buckets=buckets_in_budget(megabytes);
+	size_t bytes=sizeof(HashFileHeader)+n_buckets*sizeof(HashBucket);
+	void* lock;
+	void* p=map_locked_file(filename, bytes, lock);
+	if(p==NULL) return false;
+
+	// A header of zeros is a file that has just been made (here, or by a process that then failed)
+	HashFileHeader* header=(HashFileHeader*)p;
+	HashFileHeader blank;
+	memset(&blank, 0, sizeof(blank));
+	if(bytes>=sizeof(HashFileHeader) && memcmp(header, &blank, sizeof(blank))==0)
+	{
+		n_buckets=(bytes-sizeof(HashFileHeader))/sizeof(HashBucket);
+		if(n_buckets!=0 && (n_buckets&(n_buckets-1))==0) *header=file_header(n_buckets);
+	}
+	// Otherwise it must be a table of this format, for this board size, and complete
+	bool usable=bytes>=sizeof(HashFileHeader);
+	if(usable)
+	{
+		n_buckets=(size_t)header->n_buckets;
+		HashFileHeader expected=file_header(n_buckets);
+		usable=memcmp(header, &expected, sizeof(expected))==0
+			&& n_buckets!=0 && (n_buckets&(n_buckets-1))==0
+			&& bytes==sizeof(HashFileHeader)+n_buckets*sizeof(HashBucket);
+	}
+	unlock_file(lock);
+	if(!usable)
+	{
+		unmap_file(p, bytes);
+		return false;
+	}
+
+	close_file();
+	vector<char>().swap(storage);
+	mapping=p;
+	mapping_bytes=bytes;
+	buckets=(HashBucket*)(header+1);
+	bucket_mask=(unsigned _int32)(n_buckets-1);
+	reset_counters();
+	for(size_t i=0;i<n_buckets;i++)
+	{
+		for(int j=0;j<BUCKET_SLOTS;j++)
+		{
+			if(buckets[i].slot[j].data.load(memory_order_relaxed)!=0) initial_entries++;
+		}
+	}
+	return true;
+}
+
+void ZobristHash::close_file(void)
+{
+	if(mapping==NULL) return;
+	unmap_file(mapping, mapping_bytes);
+	mapping=NULL;
+	mapping_bytes=0;
+}
+
+void ZobristHash::reset_counters(void)
+{
+	for(int i=0;i<MAX_HASH_THREADS;i++)
+	{
+		ThreadCounts& c=counters[i];
+		for(int kind=0;kind<2;kind++)
+		{
+			for(int d=0;d<STATS_DEPTHS;d++) c.queries[kind][d]=c.hits[kind][d]=c.shallow_hits[kind][d]=0;
+		}
+		c.region_queries=c.region_hits=c.proof_queries=c.proof_hits=c.lambda_queries=c.lambda_hits=c.collisions=0;
+		c.stores=c.updates=c.overwrites=c.new_entries=0;
+	}
+	initial_entries=0;
+}
+
+// Each thread is given its own counters the first time it uses any table. (More than
+// MAX_HASH_THREADS threads share counters, which can then lose counts but nothing else.)
+static int thread_slot(void)
+{
+	static atomic<int> next_slot(0);
+	static thread_local int slot = next_slot++ % MAX_HASH_THREADS;
+	return slot;
+}
+
+// Only the owning thread writes its counters, so there is no need for an atomic increment
+static void count(atomic<int>& counter)
+{
+	counter.store(counter.load(memory_order_relaxed)+1, memory_order_relaxed);
+}
+
+static void add_count(int& total, const atomic<int>& counter)
+{
+	total+=counter.load(memory_order_relaxed);
+}
+
+HashStats ZobristHash::stats(void)
+{
+	HashStats total;
+	memset(&total, 0, sizeof(total));
+	total.n_entries=initial_entries;
+	for(int i=0;i<MAX_HASH_THREADS;i++)
+	{
+		const ThreadCounts& c=counters[i];
+		for(int kind=0;kind<2;kind++)
+		{
+			for(int d=0;d<STATS_DEPTHS;d++)
+			{
+				add_count(total.depth_queries[kind][d], c.queries[kind][d]);
+				add_count(total.depth_hits[kind][d], c.hits[kind][d]);
+				add_count(total.shallow_hits[kind][d], c.shallow_hits[kind][d]);
+			}
+		}
+		add_count(total.region_queries, c.region_queries);
+		add_count(total.region_hits, c.region_hits);
+		add_count(total.proof_queries, c.proof_queries);
+		add_count(total.proof_hits, c.proof_hits);
+		add_count(total.lambda_queries, c.lambda_queries);
+		add_count(total.lambda_hits, c.lambda_hits);
+		add_count(total.collisions, c.collisions);
+		add_count(total.stores, c.stores);
+		add_count(total.updates, c.updates);
+		add_count(total.overwrites, c.overwrites);
+		add_count(total.n_entries, c.new_entries);
+	}
+	for(int kind=0;kind<2;kind++)
+	{
+		for(int d=0;d<STATS_DEPTHS;d++)
+		{
+			total.queries+=total.depth_queries[kind][d];
+			total.positive_queries+=total.depth_hits[kind][d];
+		}
+	}
+	return total;
+}
+
+// The data word of an entry: the value in bits 0-15, depth+1 in bits 16-31 (so that a stored
+// entry is never 0; depths are never negative), the generation in bits 32-39 and move+1 in bits 40-49.
+static _int64 pack_entry(int value, int depth, int generation, int move)
+{
+	return (_int64)value | ((_int64)(depth+1))<<16 | ((_int64)generation)<<32 | ((_int64)(move+1))<<40;
+}
+static int entry_value(_int64 data){return (int)(data & 0xFFFF);}
+static int entry_depth(_int64 data){return (int)((data>>16) & 0xFFFF)-1;}
+static int entry_generation(_int64 data){return (int)((data>>32) & (N_GENERATIONS-1));}
+static int entry_move(_int64 data){return (int)((data>>40) & 0x3FF)-1;}
+// Fails to compile if a move on the largest board does not fit in its field
+typedef char move_bits_check[MAX_POINTS<0x3FF ? 1 : -1];
+
+// A df-pn entry keeps the proof number as its value and the effort as its depth, so that the table
+// weighs it like a result read that deep, and the disproof number in bits 50-63. Those reach the
+// sign bit, so they are shifted as unsigned.
+static _int64 pack_proof(const ProofNumbers& numbers, int generation, int move)
+{
+	return pack_entry(numbers.proof, numbers.effort, generation, move) | (_int64)((unsigned long long)numbers.disproof<<50);
+}
+static int entry_disproof(_int64 data){return (int)(((unsigned long long)data>>50) & PROOF_INFINITY);}
+
+// How many generations ago an entry was last stored or used
+int ZobristHash::entry_age(_int64 data)
+{
+	return (generation-entry_generation(data)) & (N_GENERATIONS-1);
+}
+
+// Which of two depth-preferred slots to give up first: empty ones, then ones from earlier
+// generations (the oldest first), then the shallowest
+bool ZobristHash::replace_before(_int64 data1, _int64 data2)
+{
+	if(data1==0 || data2==0) return data1==0 && data2!=0;
+	if(entry_age(data1)!=entry_age(data2)) return entry_age(data1)>entry_age(data2);
+	return entry_depth(data1)<entry_depth(data2);
+}
 
-ZobristHash::ZobristHash(int board_size)
+// Start the next generation. Entries stored from now on are preferred to older ones when a bucket
+// is full, so results for positions that can no longer arise make way without sweeping the table.
+void ZobristHash::new_generation(void)
 {
-	queries=0;
-	positive_queries=0;
-	srand(0);
-	//srand((unsigned)time(0));
-	// Fill list with 32-bit values, for b and w stones
-	for(int i=0; i<2*board_size*board_size; i++)
+	generation=(generation+1) & (N_GENERATIONS-1);
+}
+
+// Number of entries of each age (entry_age), for the hash command. This one does visit every slot.
+void ZobristHash::count_generations(vector<int>& output)
+{
+	output.assign(N_GENERATIONS, 0);
+	for(unsigned _int32 i=0;i<=bucket_mask;i++)
 	{
-		white_values.push_back(rand() ^ (rand()<<5) ^ (rand()<<17));
-		black_values.push_back(rand() ^ (rand()<<5) ^ (rand()<<17));
+		for(int j=0;j<BUCKET_SLOTS;j++)
+		{
+			_int64 data=buckets[i].slot[j].data.load(memory_order_relaxed);
+			if(data!=0) output[entry_age(data)]++;
+		}
 	}
 }
 
+// Number of buckets with each number of slots in use, 0 to BUCKET_SLOTS. This one visits every slot too.
+void ZobristHash::count_occupancy(vector<int>& output)
+{
+	output.assign(BUCKET_SLOTS+1, 0);
+	for(unsigned _int32 i=0;i<=bucket_mask;i++)
+	{
+		int used=0;
+		for(int j=0;j<BUCKET_SLOTS;j++)
+		{
+			if(buckets[i].slot[j].data.load(memory_order_relaxed)!=0) used++;
+		}
+		output[used]++;
+	}
+}
+
+// One "name value" line each: board_size, capacity (slots), table_bytes, used_bytes (in the slots in
+// use), file_backed (0 or 1), generation, entries, queries, hits, region_queries, region_hits,
+// proof_queries, proof_hits, lambda_queries, lambda_hits, collisions, stores, updates, overwrites; then <kind>_depth<d>_queries, _hits and _shallow_hits for
+// kind escape and capture and each depth d below STATS_DEPTHS (the last counting deeper queries too);
+// then buckets_with_<n>_entries for each n from 0 to BUCKET_SLOTS.
+void ZobristHash::write_stats(ostream& out)
+{
+	HashStats s=stats();
+	out<<"board_size "<<board_size<<"\n";
+	out<<"capacity "<<capacity()<<"\n";
+	out<<"table_bytes "<<table_bytes()<<"\n";
+	out<<"used_bytes "<<(size_t)s.n_entries*sizeof(HashEntry)<<"\n";
+	out<<"file_backed "<<(is_file_backed() ? 1 : 0)<<"\n";
+	out<<"generation "<<generation<<"\n";
+	out<<"entries "<<s.n_entries<<"\n";
+	out<<"queries "<<s.queries<<"\n";
+	out<<"hits "<<s.positive_queries<<"\n";
+	out<<"region_queries "<<s.region_queries<<"\n";
+	out<<"region_hits "<<s.region_hits<<"\n";
+	out<<"proof_queries "<<s.proof_queries<<"\n";
+	out<<"proof_hits "<<s.proof_hits<<"\n";
+	out<<"lambda_queries "<<s.lambda_queries<<"\n";
+	out<<"lambda_hits "<<s.lambda_hits<<"\n";
+	out<<"collisions "<<s.collisions<<"\n";
+	out<<"stores "<<s.stores<<"\n";
+	out<<"updates "<<s.updates<<"\n";
+	out<<"overwrites "<<s.overwrites<<"\n";
+	for(int kind=0;kind<2;kind++)
+	{
+		const char* name=(kind==1 ? "capture" : "escape");
+		for(int d=0;d<STATS_DEPTHS;d++)
+		{
+			out<<name<<"_depth"<<d<<"_queries "<<s.depth_queries[kind][d]<<"\n";
+			out<<name<<"_depth"<<d<<"_hits "<<s.depth_hits[kind][d]<<"\n";
+			out<<name<<"_depth"<<d<<"_shallow_hits "<<s.shallow_hits[kind][d]<<"\n";
+		}
+	}
+	vector<int> occupancy;
+	count_occupancy(occupancy);
+	for(int n=0;n<=BUCKET_SLOTS;n++) out<<"buckets_with_"<<n<<"_entries "<<occupancy[n]<<"\n";
+}
+
 void ZobristHash::print_zobrist_values(void)
 {
-	for(vector<int>::iterator ii=white_values.begin();ii!=white_values.end();ii++)
-	{cout<<"\n"<<(*ii);}
-	for(vector<int>::iterator ii=black_values.begin();ii!=black_values.end();ii++)
-	{cout<<"\n"<<(*ii);}
+	for(int i=0;i<board_size*board_size;i++)
+	{cout<<"\n"<<white_values[i];}
+	for(int i=0;i<board_size*board_size;i++)
+	{cout<<"\n"<<black_values[i];}
+}
+// The hash of a variant of the position. The side to move only adds white_to_move_value when
+// White is to move, so with colours swapped it is the other way round.
+_int64 ZobristHash::position_key(BoardState& b, int variant)
+{
+	return b.variant_hash[variant] ^ (variant>=N_SYMMETRIES ? white_to_move_value : 0);
+}
+
+// The lowest position key of all the variants, which picks the bucket
+_int64 ZobristHash::canonical_position(BoardState& b)
+{
+	_int64 lowest=position_key(b, 0);
+	for(int v=1;v<N_HASH_VARIANTS;v++) lowest=min(lowest, position_key(b, v));
+	return lowest;
+}
+
+// The key of each variant of a region: the stones in the box and in the ring around it (which decide
+// the liberties of the lumps inside), the ko point if it is there, the side to move and the box,
+// all turned by the variant.
+// N is the board size where it is known at compile time (0 where it isn't), so the coordinate arithmetic
+// for every point of the ring is by a constant.
+template<int N> void ZobristHash::sized_region_keys(BoardState& b, const Box& region, _int64* keys)
+{
+	const int size=(N ? N : board_size);
+	int n=size-1;
+	for(int v=0;v<N_HASH_VARIANTS;v++)
+	{
+		const vector<short>& turn=symmetry[v%N_SYMMETRIES];
+		int corner1=turn[region.left+size*region.top];
+		int corner2=turn[region.right+size*region.bottom];
+		int x1=corner1%size, y1=corner1/size, x2=corner2%size, y2=corner2/size;
+		keys[v]=box_values[min(x1, x2)] ^ box_values[MAX_BOARD_SIZE+max(x1, x2)]
+			^ box_values[2*MAX_BOARD_SIZE+min(y1, y2)] ^ box_values[3*MAX_BOARD_SIZE+max(y1, y2)];
+		if((b.to_move==WHITE)!=(v>=N_SYMMETRIES)) keys[v]^=white_to_move_value;
+	}
+	Box ring=region;
+	ring.add(max(region.left-1, 0), max(region.top-1, 0));
+	ring.add(min(region.right+1, n), min(region.bottom+1, n));
+	for(int y=ring.top;y<=ring.bottom;y++)
+	{
+		for(int x=ring.left;x<=ring.right;x++)
+		{
+			int pos=x+size*y;
+			if(b.board[pos]==NO_LUMP) continue;
+			const _int64* values=&variant_stone_values[(pos*2+b.lump_colour[b.board[pos]])*N_HASH_VARIANTS];
+			for(int v=0;v<N_HASH_VARIANTS;v++) keys[v]^=values[v];
+		}
+	}
+	int ko=b.ko_marker;
+	if(ko!=-1 && ring.contains(ko%size, ko/size))
+	{
+		for(int v=0;v<N_HASH_VARIANTS;v++) keys[v]^=variant_ko_values[ko*N_HASH_VARIANTS+v];
+	}
+}
+
+// Called at every node given a region, so the board size is picked once here
+void ZobristHash::region_keys(BoardState& b, const Box& region, _int64* keys)
+{
+	switch(board_size)
+	{
+	case 9: sized_region_keys<9>(b, region, keys); break;
+	case 13: sized_region_keys<13>(b, region, keys); break;
+	case 19: sized_region_keys<19>(b, region, keys); break;
+	default: sized_region_keys<0>(b, region, keys);
+	}
+}
+
+// The key of a query, as above, about the whole position or just region. variant is set to the
+// variant it was taken from, and position to the canonical position (or region) key.
+_int64 ZobristHash::query_key(BoardState& b, bool want_capturable, int target, const Box* region, int& variant, _int64& position)
+{
+	assert(b.board_size==board_size); // The symmetries are those of this board size
+	_int64 keys[N_HASH_VARIANTS];
+	if(region==NULL)
+	{
+		for(int v=0;v<N_HASH_VARIANTS;v++) keys[v]=position_key(b, v);
+	} else {
+		region_keys(b, *region, keys);
+	}
+	_int64 lowest=*min_element(keys, keys+N_HASH_VARIANTS);
+	position=lowest;
+	_int64 key=0;
+	variant=-1;
+	int lump=b.board[target];
+	for(int v=0;v<N_HASH_VARIANTS;v++)
+	{
+		if(keys[v]!=lowest) continue;
+		_int64 k=lowest;
+		int s=b.lump_stone[lump];
+		do
+		{
+			k=k^variant_target_values[s*N_HASH_VARIANTS+v];
+			s=b.next_stone[s];
+		} while(s!=b.lump_stone[lump]);
+		if(want_capturable) k=k^capture_query_value;
+		if(variant==-1 || k<key)
+		{
+			key=k;
+			variant=v;
+		}
+	}
+	return key;
+}
+
+// The move stored with an entry was played in the position stored, so if it cannot be played in b the
+// entry is for another query whose key happens to be the same
+bool ZobristHash::impossible_move(BoardState& b, int variant, int stored_move)
+{
+	return stored_move!=-1 && (stored_move>=board_size*board_size || b.board[inverse_symmetry[variant%N_SYMMETRIES][stored_move]]!=NO_LUMP);
 }
 
 // Query function for hash takes a board state b, a target position, and a search depth.
 // Set want_capturable to true to query can_capture; set to false to query can_escape.
 // Returns ALIVE or DEAD if it can. Returns UNSETTLED if no result or result has insufficient depth.
-// The target position is replaced with the stone in the same lump whose board position is lowest
-// in case the same question is asked about a different stone in the lump.
-int ZobristHash::query_hash(BoardState& b, bool want_capturable, int target, int depth)
+// Any stone of the target lump gives the same answer.
+int ZobristHash::query_hash(BoardState& b, bool want_capturable, int target, int depth, int* move, const Box* region)
 {
-	//return UNSETTLED;
-	//target = *(min_element(b.board[target]->stones.begin(), b.board[target]->stones.end()));
-	queries++;
-	_int64 query_hash = (_int64)b.hash_value;
-	query_hash = query_hash ^ (((_int64)target)<<33); // Target takes at most 9 bits
-	if(want_capturable)
+	ThreadCounters& c = counters[thread_slot()];
+	int kind = (want_capturable ? 1 : 0);
+	int stats_depth = max(0, min(depth, STATS_DEPTHS-1));
+	count(c.queries[kind][stats_depth]);
+	if(region!=NULL) count(c.region_queries);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, want_capturable, target, region, variant, position);
+	bool found;
+	int result = lookup(b, bucket(position), query_hash, variant, depth, move, found, c);
+	if(result!=UNSETTLED)
+	{
+		count(c.hits[kind][stats_depth]);
+		if(region!=NULL) count(c.region_hits);
+	} else if(found)
 	{
-		query_hash = query_hash ^ ((_int64)1)<<(33+9);
+		count(c.shallow_hits[kind][stats_depth]);
 	}
-	unordered_map<_int64, int>::iterator ii=hash_table.find(query_hash);
+	return result;
+}
 
-	if(ii!=hash_table.end())
+// The entry for query_hash in bucket bb, as query_hash returns it. found is set if there was one,
+// even if it was too shallow.
+int ZobristHash::lookup(BoardState& b, HashBucket& bb, _int64 query_hash, int variant, int depth, int* move, bool& found, ThreadCounters& c)
+{
+	found=false;
+	if(move!=NULL) *move=-1;
+	for(int i=0;i<BUCKET_SLOTS;i++)
 	{
-		if((*ii).second==0) 
-		{			
-			positive_queries++; 
-			return DEAD;
+		_int64 data = bb.slot[i].data.load(memory_order_relaxed);
+		if(data==0 || (bb.slot[i].check.load(memory_order_relaxed)^data)!=query_hash) continue;
+		int value = entry_value(data);
+		int stored_move = entry_move(data);
+		if(impossible_move(b, variant, stored_move))
+		{
+			count(c.collisions);
+			return UNSETTLED;
 		}
-		else if((*ii).second >= depth)
+		found=true;
+		if(move!=NULL && stored_move!=-1) *move=inverse_symmetry[variant%N_SYMMETRIES][stored_move];
+		if(value==0 || value >= depth)
 		{
-			positive_queries++; 
-			return ALIVE;
+			// A result still in use is kept as if it had just been stored
+			if(entry_age(data)!=0)
+			{
+				store(bb.slot[i], query_hash, pack_entry(value, entry_depth(data), generation, stored_move), c);
+			}
+			return (value==0 ? DEAD : ALIVE);
 		}
+		return UNSETTLED;
 	}
 	return UNSETTLED;
 }
 
-// Add an entry to hash table
-void ZobristHash::insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result)
+// Add an entry to hash table. If no move is given, any move already stored for the query is kept.
+void ZobristHash::insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result, int move, const Box* region)
+{
+	ThreadCounters& c = counters[thread_slot()];
+	count(c.stores);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, want_capturable, target, region, variant, position);
+	bool captured = (want_capturable && result) || (!want_capturable && !result);
+	if(move!=-1) move=symmetry[variant%N_SYMMETRIES][move];
+	record(bucket(position), query_hash, captured, depth, move, c);
+}
+
+// Store a result for query_hash in bucket bb, with move already in the stored variant's coordinates
+void ZobristHash::record(HashBucket& bb, _int64 query_hash, bool captured, int depth, int move, ThreadCounters& c)
+{
+	assert(depth>=0 && depth<0xFFFF);
+
+	// Take a copy of the bucket, since other threads may be changing it
+	_int64 key[BUCKET_SLOTS], data[BUCKET_SLOTS];
+	for(int i=0;i<BUCKET_SLOTS;i++)
+	{
+		data[i]=bb.slot[i].data.load(memory_order_relaxed);
+		key[i]=bb.slot[i].check.load(memory_order_relaxed)^data[i];
+	}
+
+	for(int i=0;i<BUCKET_SLOTS;i++)
+	{
+		if(data[i]==0 || key[i]!=query_hash) continue;
+		int value=entry_value(data[i]);
+		if(captured)
+		{
+			// Store a capture result
+			value=0;
+		} else if(value==0)
+		{
+			// A capture holds at every depth, so a non-capture result leaves it (and its move) alone
+			move=entry_move(data[i]);
+		} else if(value < depth)
+		{
+			// Overwrite the previous (shallower) non-capture result
+			value=depth;
+		}
+		if(move==-1) move=entry_move(data[i]);
+		store(bb.slot[i], query_hash, pack_entry(value, max(entry_depth(data[i]), depth), generation, move), c);
+		count(c.updates);
+		return;
+	}
+
+	place_entry(bb, key, data, query_hash, pack_entry(captured ? 0 : depth, depth, generation, move), c);
+}
+
+// Store a new entry in bucket bb, whose slots held key and data. The depth-preferred slot to give up
+// is the first of them by replace_before. A new entry takes it if it is empty or stale, or no deeper
+// than this one; an entry of this generation pushed out of it moves to the always-replace slot.
+void ZobristHash::place_entry(HashBucket& bb, const _int64* key, const _int64* data, _int64 query_hash, _int64 entry, ThreadCounters& c)
 {
-	//target = *(min_element(b.board[target]->stones.begin(), b.board[target]->stones.end()));
-	_int64 query_hash = (_int64)b.hash_value;
-	query_hash = query_hash ^ (((_int64)target)<<33); // Target takes at most 9 bits
-	if(want_capturable)
+	int depth=entry_depth(entry);
+	int victim=0;
+	for(int i=1;i<DEPTH_SLOTS;i++)
+	{
+		if(replace_before(data[i], data[victim])) victim=i;
+	}
+	if(data[victim]==0 || entry_age(data[victim])!=0)
+	{
+		if(data[victim]!=0) count(c.overwrites);
+		store(bb.slot[victim], query_hash, entry, c);
+	} else if(depth>=entry_depth(data[victim]))
 	{
-		query_hash = query_hash ^ ((_int64)1)<<(33+9);
+		if(data[DEPTH_SLOTS]!=0) count(c.overwrites);
+		store(bb.slot[DEPTH_SLOTS], key[victim], data[victim], c);
+		store(bb.slot[victim], query_hash, entry, c);
+	} else {
+		if(data[DEPTH_SLOTS]!=0) count(c.overwrites);
+		store(bb.slot[DEPTH_SLOTS], query_hash, entry, c);
+	}
+}
+
+// df-pn entries are about capturing the target, with the attacker or the defender to move (which
+// the position key tells apart)
+bool ZobristHash::query_proof(BoardState& b, int target, ProofNumbers& out)
+{
+	ThreadCounters& c = counters[thread_slot()];
+	count(c.proof_queries);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, true, target, NULL, variant, position)^proof_query_value;
+	HashBucket& bb = bucket(position);
+	for(int i=0;i<BUCKET_SLOTS;i++)
+	{
+		_int64 data = bb.slot[i].data.load(memory_order_relaxed);
+		if(data==0 || (bb.slot[i].check.load(memory_order_relaxed)^data)!=query_hash) continue;
+		int stored_move = entry_move(data);
+		if(impossible_move(b, variant, stored_move))
+		{
+			count(c.collisions);
+			return false;
+		}
+		if(entry_age(data)!=0) store(bb.slot[i], query_hash, (data & ~(((_int64)N_GENERATIONS-1)<<32)) | ((_int64)generation)<<32, c);
+		out.proof=entry_value(data);
+		out.disproof=entry_disproof(data);
+		out.effort=entry_depth(data);
+		out.move=(stored_move==-1 ? -1 : inverse_symmetry[variant%N_SYMMETRIES][stored_move]);
+		count(c.proof_hits);
+		return true;
 	}
+	return false;
+}
 
-	unordered_map<_int64, int>::iterator ii = hash_table.find(query_hash);
+void ZobristHash::insert_proof(BoardState& b, int target, const ProofNumbers& numbers)
+{
+	ThreadCounters& c = counters[thread_slot()];
+	count(c.stores);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, true, target, NULL, variant, position)^proof_query_value;
+	HashBucket& bb = bucket(position);
+	assert(numbers.proof>=0 && numbers.proof<=PROOF_INFINITY && numbers.disproof>=0 && numbers.disproof<=PROOF_INFINITY);
+	assert(numbers.effort>=0 && numbers.effort<0xFFFF);
+	_int64 entry=pack_proof(numbers, generation, numbers.move==-1 ? -1 : symmetry[variant%N_SYMMETRIES][numbers.move]);
 
-	if((want_capturable && result) || (!want_capturable && !result))
+	_int64 key[BUCKET_SLOTS], data[BUCKET_SLOTS];
+	for(int i=0;i<BUCKET_SLOTS;i++)
 	{
-		// Store a capture result
-		hash_table[query_hash]=0;
-	} else if(ii==hash_table.end() || (*ii).second < depth)
+		data[i]=bb.slot[i].data.load(memory_order_relaxed);
+		key[i]=bb.slot[i].check.load(memory_order_relaxed)^data[i];
+	}
+	for(int i=0;i<BUCKET_SLOTS;i++)
 	{
-		// Overwrite the previous (shallower) non-capture result if it's there
-		hash_table[query_hash]=depth;
+		if(data[i]==0 || key[i]!=query_hash) continue;
+		store(bb.slot[i], query_hash, entry, c);
+		count(c.updates);
+		return;
 	}
+	place_entry(bb, key, data, query_hash, entry, c);
 }
-// Updates hash value in place
-void ZobristHash::add_stone(int pos, int colour, _int32& hash_value)
+
+// Lambda search entries are about capturing the target with the attacker to move, one order at a time
+int ZobristHash::query_lambda(BoardState& b, int target, int order, int depth, int* move)
 {
-	if(colour==BLACK) hash_value=black_values[pos]^hash_value;
-	else hash_value=white_values[pos]^hash_value;
+	assert(order>=1 && order<=MAX_LAMBDA_ORDER);
+	ThreadCounters& c = counters[thread_slot()];
+	count(c.lambda_queries);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, true, target, NULL, variant, position)^lambda_query_values[order-1];
+	bool found;
+	int result = lookup(b, bucket(position), query_hash, variant, depth, move, found, c);
+	if(result!=UNSETTLED) count(c.lambda_hits);
+	return result;
 }
-void ZobristHash::remove_stone(int pos, int colour, _int32& hash_value)
+
+void ZobristHash::insert_lambda(BoardState& b, int target, int order, int depth, bool result, int move)
 {
-	if(colour==BLACK) hash_value=black_values[pos]^hash_value;
-	else hash_value=white_values[pos]^hash_value;
-}
\ No newline at end of file
+	assert(order>=1 && order<=MAX_LAMBDA_ORDER);
+	ThreadCounters& c = counters[thread_slot()];
+	count(c.stores);
+	int variant;
+	_int64 position;
+	_int64 query_hash = query_key(b, true, target, NULL, variant, position)^lambda_query_values[order-1];
+	if(move!=-1) move=symmetry[variant%N_SYMMETRIES][move];
+	record(bucket(position), query_hash, result, depth, move, c);
+}
+
+void ZobristHash::store(HashEntry& slot, _int64 key, _int64 data, ThreadCounters& c)
+{
+	if(slot.data.load(memory_order_relaxed)==0) count(c.new_entries);
+	slot.data.store(data, memory_order_relaxed);
+	slot.check.store(key^data, memory_order_relaxed);
+}
+
+void ZobristHash::prefetch(BoardState& b)
+{
+#ifdef _MSC_VER
+	_mm_prefetch((const char*)&bucket(canonical_position(b)), _MM_HINT_T0);
+#else
+	__builtin_prefetch(&bucket(canonical_position(b)));
+#endif
+}
@@ -2,39 +2,295 @@
 #define HASHING_H_120812
 
 #include <vector>
-#include <unordered_map>
+#include <string>
 #include <iostream>
+#include <atomic>
 #include "board.h"
-class BoardState;
+#include "globals.h"
 
-class HashObject
+// Hash policies. The board and the reader take the policy as a template parameter (see play_move in
+// board.cpp and can_capture in reading.cpp) rather than calling virtual functions, so that the calls
+// made for every stone and every node are direct and the updates below are inlined. Each policy has:
+//
+// int query_hash(BoardState& b, bool want_capturable, int target, int depth, int* move, const Box* region)
+// void insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result, int move, const Box* region)
+//   The move that proved a result (the capturing or escaping move) can be stored with it, and is
+//   handed back by query_hash through move (-1 if there is none), even when the depth falls short.
+//   Given a region, the query is about the stones in and around that box only, so the result
+//   holds in any position that agrees there (see region_keys in hashing.cpp).
+// bool query_proof(BoardState& b, int target, ProofNumbers& out)
+// void insert_proof(BoardState& b, int target, const ProofNumbers& numbers)
+//   The df-pn solver's proof and disproof numbers for capturing target in the position (see dfpn.cpp).
+//   query_proof returns false if there are none.
+// int query_lambda(BoardState& b, int target, int order, int depth, int* move)
+// void insert_lambda(BoardState& b, int target, int order, int depth, bool result, int move)
+//   The lambda solver's results (see lambda.cpp): whether the attacker, to move, captures target with
+//   a lambda tree of that order in depth moves. They work as query_hash and insert_hash for
+//   can_capture, but each order is kept apart from the others and from the fixed-depth reader.
+// void add_stone(BoardState& b, int pos, int colour), remove_stone (the same)
+// void change_ko(BoardState& b, int old_ko, int new_ko) (either may be -1 for no ko)
+// void change_to_move(BoardState& b)
+//   These update b.hash_value (and b.variant_hash, if the policy uses it) in place.
+// void prefetch(BoardState& b)
+//   The position is about to be looked up.
+//
+// A board uses ZobristHash if b.hash points to one, and NullHash if it is NULL.
+
+// The Zobrist values, laid out as described in hashing.cpp
+const _int64* zobrist_values(void);
+
+// What the df-pn solver knows about capturing a target in one position: how much work it expects
+// to prove that the target can be captured, and to disprove it. 0 is done, PROOF_INFINITY is impossible.
+const int PROOF_INFINITY = 0x3FFF; // Proof numbers are kept in 14 bits
+struct ProofNumbers
 {
-public:
-	virtual int query_hash(BoardState& b, bool want_capturable, int target, int depth){return 0;}
-	virtual void insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result){}
-	virtual void add_stone(int pos, int colour, _int32& hash_value){};
-	virtual void remove_stone(int pos, int colour, _int32& hash_value){};
+	int proof;
+	int disproof;
+	int move; // The move to try first, or -1
+	int effort; // log2 of the nodes spent on the position, which the table keeps in place of a depth
 };
 
-class ZobristHash: public HashObject
+// Highest order of lambda search the table has keys for
+const int MAX_LAMBDA_ORDER = 4;
+
+// No table: nothing is stored and nothing is found. b.hash_value is still kept, since repetitions
+// are spotted with it, but not the variants, so reading with this policy costs what it would with
+// no hashing at all.
+class NullHash
 {
 public:
-	std::vector<_int32> white_values;
-	std::vector<_int32> black_values;
-	std::unordered_map<_int64, int> hash_table;
+	NullHash(void): values(zobrist_values()){}
+	int query_hash(BoardState& b, bool want_capturable, int target, int depth, int* move=NULL, const Box* region=NULL)
+	{
+		if(move!=NULL) *move=-1;
+		return UNSETTLED;
+	}
+	void insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result, int move=-1, const Box* region=NULL){}
+	bool query_proof(BoardState& b, int target, ProofNumbers& out){return false;}
+	void insert_proof(BoardState& b, int target, const ProofNumbers& numbers){}
+	int query_lambda(BoardState& b, int target, int order, int depth, int* move=NULL)
+	{
+		if(move!=NULL) *move=-1;
+		return UNSETTLED;
+	}
+	void insert_lambda(BoardState& b, int target, int order, int depth, bool result, int move=-1){}
+	void add_stone(BoardState& b, int pos, int colour){b.hash_value^=values[(colour==BLACK ? 0 : MAX_POINTS)+pos];}
+	void remove_stone(BoardState& b, int pos, int colour){add_stone(b, pos, colour);}
+	void change_ko(BoardState& b, int old_ko, int new_ko)
+	{
+		if(old_ko!=-1) b.hash_value^=values[2*MAX_POINTS+old_ko];
+		if(new_ko!=-1) b.hash_value^=values[2*MAX_POINTS+new_ko];
+	}
+	void change_to_move(BoardState& b){b.hash_value^=values[4*MAX_POINTS];}
+	void prefetch(BoardState& b){}
+private:
+	const _int64* values;
+};
 
+// One slot of the table. Threads read and write slots without locking, so a slot can end up with
+// the check word of one store and the data of another; keeping key^data rather than the key means
+// such a torn slot matches no key. Entries are only matched when all 64 bits of the key agree.
+struct HashEntry
+{
+	std::atomic<_int64> check; // The key XOR data
+	std::atomic<_int64> data; // See pack_entry in hashing.cpp; 0 if the slot is empty
+};
+
+// The queries about one position go to the same bucket, which fills one cache line. The first
+// DEPTH_SLOTS slots keep the deepest results that land in the bucket; the last one always takes
+// a new result that is too shallow for them, or the one it pushed out.
+const int BUCKET_SLOTS = 4;
+const int DEPTH_SLOTS = 3;
+const int CACHE_LINE = 64;
+struct HashBucket
+{
+	HashEntry slot[BUCKET_SLOTS];
+};
+
+const int DEFAULT_HASH_MB = 16;
+const int N_GENERATIONS = 256; // Generation numbers wrap around after this many
+
+// A table kept in a file starts with this header, and the buckets follow it. A process only uses a
+// file whose header matches its own, so that keys and entries mean the same thing to every user.
+// Change HASH_FILE_VERSION whenever the layout of keys or entries changes.
+const int HASH_FILE_VERSION = 7;
+struct HashFileHeader
+{
+	char magic[8];
+	_int32 version;
+	_int32 board_size;
+	_int64 key_seed; // Seed the Zobrist values were made from
+	_int32 bucket_slots;
+	_int32 entry_bytes;
+	_int64 n_buckets;
+	char padding[CACHE_LINE-40]; // So that the buckets stay aligned to cache lines
+};
+
+// Table statistics, added up over every thread that has used the table. Queries are also counted
+// by kind, [0] for can_escape and [1] for can_capture, and by the depth asked for (any depth from
+// STATS_DEPTHS-1 up counts as STATS_DEPTHS-1). A region-local query that misses goes on to ask about
+// the whole position, so it is counted twice.
+const int STATS_DEPTHS = 16;
+struct HashStats
+{
 	int queries;
 	int positive_queries;
+	int n_entries; // Slots in use
+	int depth_queries[2][STATS_DEPTHS];
+	int depth_hits[2][STATS_DEPTHS];
+	int shallow_hits[2][STATS_DEPTHS]; // The query was in the table, but searched less deeply than asked
+	int region_queries; // Those of the queries that were region-local
+	int region_hits;
+	int proof_queries; // df-pn lookups, which are not counted among the queries above
+	int proof_hits;
+	int lambda_queries; // Lambda search lookups, likewise
+	int lambda_hits;
+	int collisions; // Keys that matched an entry whose move cannot be played in the position asked about
+	int stores; // Calls to insert_hash, insert_proof and insert_lambda
+	int updates; // Stores to an entry for the same query
+	int overwrites; // Stores that pushed another query's entry out of the table
+};
 
-	ZobristHash(int board_size);
-	~ZobristHash(){}
+// Each thread counts in its own slot, padded to whole cache lines so that threads do not share one
+const int MAX_HASH_THREADS = 64;
+struct ThreadCounts
+{
+	std::atomic<int> queries[2][STATS_DEPTHS];
+	std::atomic<int> hits[2][STATS_DEPTHS];
+	std::atomic<int> shallow_hits[2][STATS_DEPTHS];
+	std::atomic<int> region_queries;
+	std::atomic<int> region_hits;
+	std::atomic<int> proof_queries;
+	std::atomic<int> proof_hits;
+	std::atomic<int> lambda_queries;
+	std::atomic<int> lambda_hits;
+	std::atomic<int> collisions;
+	std::atomic<int> stores;
+	std::atomic<int> updates;
+	std::atomic<int> overwrites;
+	std::atomic<int> new_entries;
+};
+struct ThreadCounters: public ThreadCounts
+{
+	char padding[CACHE_LINE-sizeof(ThreadCounts)%CACHE_LINE];
+};
+
+class ZobristHash
+{
+public:
+	// Values for each point, shared by every hash object (see hashing.cpp)
+	const _int64* white_values;
+	const _int64* black_values;
+	const _int64* ko_values;
+	const _int64* target_values;
+	const _int64* box_values; // For the left, right, top and bottom edges of a region, MAX_BOARD_SIZE of each
+	_int64 white_to_move_value;
+	_int64 capture_query_value;
+	_int64 proof_query_value;
+	const _int64* lambda_query_values; // One for each order from 1 to MAX_LAMBDA_ORDER, at [order-1]
+	int board_size;
+
+	// For each variant, the values of a black or white stone, a ko point or a target at each point
+	// of this board: those of the point it moves to under the symmetry, with colours swapped if need be.
+	// Indexed [(pos*2+colour)*N_HASH_VARIANTS+variant], or [pos*N_HASH_VARIANTS+variant].
+	std::vector<_int64> variant_stone_values;
+	std::vector<_int64> variant_ko_values;
+	std::vector<_int64> variant_target_values;
+	// Where each point goes under each symmetry, and back
+	std::vector<short> symmetry[N_SYMMETRIES];
+	std::vector<short> inverse_symmetry[N_SYMMETRIES];
+
+	// One table can be shared by boards being read in different threads at once
+	ZobristHash(int board_size, int megabytes=DEFAULT_HASH_MB); // The table is allocated up front and never grows
+	~ZobristHash(){close_file();}
 
 	void print_zobrist_values(void);
+	void clear(void); // Not while anything is reading
+	HashStats stats(void);
 
-	int query_hash(BoardState& b, bool want_capturable, int target, int depth);
-	void insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result);
-	void add_stone(int pos, int colour, _int32& hash_value);
-	void remove_stone(int pos, int colour, _int32& hash_value);
+	// Keep the table in a memory-mapped file, which other processes can use at the same time and which
+	// keeps its contents from one run to the next. The file is created (with room for megabytes) if it
+	// does not exist. Returns false, and keeps the table as it was, if the file cannot be used
+	// (for instance because it was made for another board size or version).
+	bool open_file(const std::string& filename, int megabytes=DEFAULT_HASH_MB);
+	bool is_file_backed(void){return mapping!=NULL;}
+
+	// The engine starts a new generation for each move (see new_generation in hashing.cpp)
+	int generation;
+	void new_generation(void);
+	void count_generations(std::vector<int>& output);
+	void count_occupancy(std::vector<int>& output);
+	int capacity(void){return (int)(bucket_mask+1)*BUCKET_SLOTS;}
+	size_t table_bytes(void){return (bucket_mask+1)*sizeof(HashBucket);}
+	// Every statistic as a "name value" line, for other programs to read (see hashing.cpp for the names)
+	void write_stats(std::ostream& out);
+
+	int query_hash(BoardState& b, bool want_capturable, int target, int depth, int* move=NULL, const Box* region=NULL);
+	void insert_hash(BoardState& b, bool want_capturable, int target, int depth, bool result, int move=-1, const Box* region=NULL);
+	bool query_proof(BoardState& b, int target, ProofNumbers& out);
+	void insert_proof(BoardState& b, int target, const ProofNumbers& numbers);
+	int query_lambda(BoardState& b, int target, int order, int depth, int* move=NULL);
+	void insert_lambda(BoardState& b, int target, int order, int depth, bool result, int move=-1);
+	void add_stone(BoardState& b, int pos, int colour);
+	void remove_stone(BoardState& b, int pos, int colour);
+	void change_ko(BoardState& b, int old_ko, int new_ko);
+	void change_to_move(BoardState& b);
+	void prefetch(BoardState& b);
+
+private:
+	std::vector<char> storage;
+	void* mapping; // The mapped file (header then buckets), or NULL if the table is in storage
+	size_t mapping_bytes;
+	HashBucket* buckets; // Inside storage or mapping, aligned to a cache line
+	int initial_entries; // Slots already in use when the file was opened
+	unsigned _int32 bucket_mask; // Number of buckets (a power of two) minus one
+	ThreadCounters counters[MAX_HASH_THREADS];
+	HashBucket& bucket(_int64 hash_value){return buckets[(unsigned _int32)hash_value & bucket_mask];}
+	_int64 position_key(BoardState& b, int variant);
+	_int64 canonical_position(BoardState& b);
+	void region_keys(BoardState& b, const Box& region, _int64* keys);
+	template<int N> void sized_region_keys(BoardState& b, const Box& region, _int64* keys);
+	_int64 query_key(BoardState& b, bool want_capturable, int target, const Box* region, int& variant, _int64& position);
+	void store(HashEntry& slot, _int64 key, _int64 data, ThreadCounters& c);
+	int lookup(BoardState& b, HashBucket& bb, _int64 query_hash, int variant, int depth, int* move, bool& found, ThreadCounters& c);
+	void record(HashBucket& bb, _int64 query_hash, bool captured, int depth, int move, ThreadCounters& c);
+	void place_entry(HashBucket& bb, const _int64* key, const _int64* data, _int64 query_hash, _int64 entry, ThreadCounters& c);
+	bool impossible_move(BoardState& b, int variant, int stored_move);
+	void close_file(void);
+	void reset_counters(void);
+	int entry_age(_int64 data);
+	bool replace_before(_int64 data1, _int64 data2);
+	HashFileHeader file_header(size_t n_buckets);
+	ZobristHash(const ZobristHash&);
+	ZobristHash& operator=(const ZobristHash&);
 };
 
+// Update b's hash values in place. Stones and ko points go into each variant at the point the
+// variant moves them to.
+inline void ZobristHash::add_stone(BoardState& b, int pos, int colour)
+{
+	const _int64* values=&variant_stone_values[(pos*2+colour)*N_HASH_VARIANTS];
+	for(int v=0;v<N_HASH_VARIANTS;v++) b.variant_hash[v]^=values[v];
+	b.hash_value=b.variant_hash[0];
+}
+inline void ZobristHash::remove_stone(BoardState& b, int pos, int colour)
+{
+	add_stone(b, pos, colour);
+}
+inline void ZobristHash::change_ko(BoardState& b, int old_ko, int new_ko)
+{
+	if(old_ko==new_ko) return; // Usually both -1
+	for(int v=0;v<N_HASH_VARIANTS;v++)
+	{
+		if(old_ko!=-1) b.variant_hash[v]^=variant_ko_values[old_ko*N_HASH_VARIANTS+v];
+		if(new_ko!=-1) b.variant_hash[v]^=variant_ko_values[new_ko*N_HASH_VARIANTS+v];
+	}
+	b.hash_value=b.variant_hash[0];
+}
+inline void ZobristHash::change_to_move(BoardState& b)
+{
+	for(int v=0;v<N_HASH_VARIANTS;v++) b.variant_hash[v]^=white_to_move_value;
+	b.hash_value=b.variant_hash[0];
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "board.h"
+#include "globals.h"
+#include "hashing.h"
+#include "reading.h"
+#include "lambda.h"
+
+using namespace std;
+
+// Lambda search (Thomsen). A lambda tree of order n is a search in which the attacker only plays
+// moves that threaten to win with a tree of order n-1 if the defender were to pass; the defender
+// plays every move escape_moves gives. Order 0 is capturing a target in atari, and order 1 is a
+// ladder, which is_ladderable and is_laddered read. Order 2 attacks are moves after which the target
+// would be laddered, and so on. Most of the attacker's moves are not threats at all, so each tree is
+// far smaller than the full one to the same depth, and a win found in one is a win in the full tree.
+// Depth counts the attacker's moves, as in can_capture, and the threat test is done within the
+// depth that is left.
+
+template<class Hash> class LambdaSearch
+{
+public:
+	LambdaSearch(BoardState& b, Hash& h, int target, ReadingSettings& settings, ReadingLog& log):
+		b(b), hash(h), target(target), settings(settings), log(log){}
+	bool attack(int order, int depth);
+	bool defence_fails(int order, int depth);
+private:
+	BoardState& b;
+	Hash& hash;
+	int target;
+	ReadingSettings& settings;
+	ReadingLog& log;
+	bool threatens(int order, int depth);
+	LambdaSearch& operator=(const LambdaSearch&);
+};
+
+// With the attacker to move: true if it captures the target with a tree of order at most order in depth moves
+template<class Hash> bool LambdaSearch<Hash>::attack(int order, int depth)
+{
+	assert(b.board[target]!=NO_LUMP);
+	if(b.is_invincible(target)) return false;
+	int libs=b.liberties(target);
+	if(libs==1) return true;
+	if(libs>depth && libs>2) return false;
+	if(libs==2 && is_ladderable(b, target, NULL, log)) return true;
+	if(order==1 || depth<2) return false;
+
+	int hash_move;
+	int hash_result=hash.query_lambda(b, target, order, depth, &hash_move);
+	if(hash_result!=UNSETTLED) return hash_result==DEAD;
+
+	log.total_moves++;
+	if(log.out_of_budget()) return false;
+	vector<int> moves;
+	capture_moves(b, target, depth, moves, log);
+	vector<int>::iterator first=find(moves.begin(), moves.end(), hash_move);
+	if(first!=moves.end()) rotate(moves.begin(), first, first+1);
+	for(vector<int>::iterator ii=moves.begin();ii!=moves.end();ii++)
+	{
+		b.play_move(*ii);
+		log.current_depth++;
+		bool wins=(b.board[target]==NO_LUMP || (threatens(order, depth-1) && defence_fails(order, depth-1)));
+		log.current_depth--;
+		b.undo_move();
+		if(log.stopped) return false; // The answer below is no good, so store nothing
+		if(wins)
+		{
+			hash.insert_lambda(b, target, order, depth, true, *ii);
+			return true;
+		}
+	}
+	hash.insert_lambda(b, target, order, depth, false);
+	return false;
+}
+
+// After an attacking move: would the attacker win with a tree of the order below if the defender passed?
+template<class Hash> bool LambdaSearch<Hash>::threatens(int order, int depth)
+{
+	if(b.liberties(target)==1) return true;
+	b.play_move(-1);
+	bool threat=attack(order-1, depth);
+	b.undo_move();
+	return threat;
+}
+
+// With the defender to move: true if every escaping move loses to a tree of order at most order
+template<class Hash> bool LambdaSearch<Hash>::defence_fails(int order, int depth)
+{
+	assert(b.board[target]!=NO_LUMP);
+	if(b.is_invincible(target) || b.liberties(target)>=settings.escape_libs) return false;
+	if(b.liberties(target)==1 && is_laddered(b, target, log)) return true;
+
+	int hash_move;
+	int hash_result=hash.query_lambda(b, target, order, depth, &hash_move);
+	if(hash_result!=UNSETTLED) return hash_result==DEAD;
+
+	log.total_moves++;
+	if(log.out_of_budget()) return false;
+	vector<int> moves;
+	escape_moves(b, target, depth, moves, log);
+	vector<int>::iterator first=find(moves.begin(), moves.end(), hash_move);
+	if(first!=moves.end()) rotate(moves.begin(), first, first+1);
+	for(vector<int>::iterator ii=moves.begin();ii!=moves.end();ii++)
+	{
+		b.play_move(*ii);
+		log.current_depth++;
+		bool captured=attack(order, depth);
+		log.current_depth--;
+		b.undo_move();
+		if(log.stopped) return false;
+		if(!captured)
+		{
+			hash.insert_lambda(b, target, order, depth, false, *ii);
+			return false;
+		}
+	}
+	hash.insert_lambda(b, target, order, depth, true);
+	return true;
+}
+
+// Lower orders are searched first, since their trees are much the smaller, and the table keeps
+// what each found for the next
+template<class Hash> static bool lambda_capture(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(settings.lambda_order>=1 && settings.lambda_order<=MAX_LAMBDA_ORDER);
+	LambdaSearch<Hash> search(b, h, target, settings, log);
+	for(int order=1;order<=settings.lambda_order && !log.stopped;order++)
+	{
+		if(search.attack(order, depth)) return true;
+	}
+	return false;
+}
+
+template<class Hash> static bool lambda_escape(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(settings.lambda_order>=1 && settings.lambda_order<=MAX_LAMBDA_ORDER);
+	LambdaSearch<Hash> search(b, h, target, settings, log);
+	for(int order=1;order<=settings.lambda_order && !log.stopped;order++)
+	{
+		if(search.defence_fails(order, depth)) return false;
+	}
+	return true;
+}
+
+bool lambda_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(b.board[target]!=NO_LUMP && b.to_move!=b.colour(target));
+	if(b.hash!=NULL) return lambda_capture(b, *b.hash, target, depth, settings, log);
+	NullHash no_table;
+	return lambda_capture(b, no_table, target, depth, settings, log);
+}
+
+bool lambda_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	assert(b.board[target]!=NO_LUMP && b.to_move==b.colour(target));
+	if(b.hash!=NULL) return lambda_escape(b, *b.hash, target, depth, settings, log);
+	NullHash no_table;
+	return lambda_escape(b, no_table, target, depth, settings, log);
+}
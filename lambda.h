@@ -0,0 +1,14 @@
+#ifndef LAMBDA_H_300712
+#define LAMBDA_H_300712
+
+#include "board.h"
+#include "reading.h"
+
+// Lambda search for the questions the fixed-depth reader answers: can_capture (lambda_capture, with
+// the attacker to move) and can_escape (lambda_escape, with the target's side to move), to the same
+// depth. Pick it with settings.solver=LAMBDA_SOLVER; get_status and get_capturable then use it, and
+// so do the engine's connection checks. It searches orders 1 to settings.lambda_order in turn.
+bool lambda_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log);
+bool lambda_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log);
+
+#endif
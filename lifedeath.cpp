@@ -13,19 +13,19 @@
 using namespace std;
 
 
-string EyeGraph::display(void)
+string EyeGraph::display(int board_size)
 {
 	stringstream ss;
 	ss << "Eyespace";
 	ss<<"\nSpaces: ";
 	for(vector<int>::iterator ii=spaces.begin();ii!=spaces.end();ii++)
 	{
-		ss<<" ("<<(*ii)%DEBUG_BS<<","<<(int)(*ii/DEBUG_BS)<<")";
+		ss<<" ("<<(*ii)%board_size<<","<<(int)(*ii/board_size)<<")";
 	}
 	ss<<"\nAdj spaces: ";
 	for(vector<int>::iterator ii=adj_spaces.begin();ii!=adj_spaces.end();ii++)
 	{
-		ss<<" ("<<(*ii)%DEBUG_BS<<","<<(int)(*ii/DEBUG_BS)<<")";
+		ss<<" ("<<(*ii)%board_size<<","<<(int)(*ii/board_size)<<")";
 	}
 	ss<<"\nDead stones:";
 	for(vector<vector<int> >::iterator ii=dead_stones.begin();ii!=dead_stones.end();ii++)
@@ -33,7 +33,7 @@ string EyeGraph::display(void)
 		ss<<"\n";
 		for(vector<int>::iterator jj=ii->begin(); jj!=ii->end();jj++)
 		{
-			ss<<" ("<<(*jj)%DEBUG_BS<<","<<(int)(*jj/DEBUG_BS)<<") ";
+			ss<<" ("<<(*jj)%board_size<<","<<(int)(*jj/board_size)<<") ";
 		}
 	}
 	ss<<"\nCapturable stones:";
@@ -42,7 +42,7 @@ string EyeGraph::display(void)
 		ss<<"\n";
 		for(vector<int>::iterator jj=ii->begin(); jj!=ii->end();jj++)
 		{
-			ss<<" ("<<(*jj)%DEBUG_BS<<","<<(int)(*jj/DEBUG_BS)<<") ";
+			ss<<" ("<<(*jj)%board_size<<","<<(int)(*jj/board_size)<<") ";
 		}
 	}
 	ss<<"\nUndetermined enemy stones:";
@@ -51,7 +51,7 @@ string EyeGraph::display(void)
 		ss<<"\n";
 		for(vector<int>::iterator jj=ii->begin(); jj!=ii->end();jj++)
 		{
-			ss<<" ("<<(*jj)%DEBUG_BS<<","<<(int)(*jj/DEBUG_BS)<<") ";
+			ss<<" ("<<(*jj)%board_size<<","<<(int)(*jj/board_size)<<") ";
 		}
 	}
 
@@ -63,14 +63,14 @@ string EyeGraph::display(void)
 bool is_pass_alive(BoardState& b, int pos, vector<int>& codependants, ReadingLog& log)
 {
 	// Get all liberties
-	if(b.board[pos]->invincible) return true;
+	if(b.is_invincible(pos)) return true;
 	vector<int> liberties;
 	vector<int> illegal_moves;
-	vector<Lump*> pcodependants;
-	b.lump_adj_liberties(pos, HV, liberties);
+	vector<int> pcodependants;
+	b.lump_adj_liberties(b.board[pos], HV, liberties);
 
 	BoardState b_copy = b;
-	b_copy.ko_marker=-1;
+	b_copy.clear_ko();
 	
 	if(b_copy.to_move==b_copy.colour(pos)) b_copy.play_move(-1); //Keep capturer to move
 	while(!liberties.empty())
@@ -86,7 +86,7 @@ bool is_pass_alive(BoardState& b, int pos, vector<int>& codependants, ReadingLog
 		liberties.pop_back();
 	}
 
-	if(b_copy.board[pos]==NULL || b_copy.liberties(pos)==1) return false;
+	if(b_copy.board[pos]==NO_LUMP || b_copy.liberties(pos)==1) return false;
 
 	// Now we have a list of liberties which cannot be filled. We can only play them if we can remove one of their surrounding groups.
 	// For each illegal move liberty, we find a list of all neighbouring lumps of the same colour, which are
@@ -97,7 +97,7 @@ bool is_pass_alive(BoardState& b, int pos, vector<int>& codependants, ReadingLog
 	// Create list of codependant lumps (including the target itself)
 	for(vector<int>::iterator ii = codependants.begin(); ii!=codependants.end();ii++)
 	{
-		if(b_copy.board[*ii]!=NULL) pcodependants.push_back(b_copy.board[*ii]);
+		if(b_copy.board[*ii]!=NO_LUMP) pcodependants.push_back(b_copy.board[*ii]);
 	}
 	pcodependants.push_back(b_copy.board[pos]);
 	// Make our own copy of codependants list, and add the target group
@@ -105,15 +105,15 @@ bool is_pass_alive(BoardState& b, int pos, vector<int>& codependants, ReadingLog
 	store_codeps.push_back(pos);
 
 	assert(illegal_moves.size()>1);
-	vector<Lump*> capturers; // the capturing lumps surrounding the liberty
-	vector<Lump*> friends; // the friendly stones surrounding these and the liberty itself
+	vector<int> capturers; // the capturing lumps surrounding the liberty
+	vector<int> friends; // the friendly stones surrounding these and the liberty itself
 	vector<int> unremovables; // a store for the definitely unplayable ones
 	for(vector<int>::iterator ii = illegal_moves.begin();ii!=illegal_moves.end();ii++)
 	{
 		capturers.clear();
 		friends.clear();
 		b_copy.adj_lumps(*ii, HV, FRIEND, capturers);
-		for(vector<Lump*>::iterator jj=capturers.begin(); jj!=capturers.end();jj++)
+		for(vector<int>::iterator jj=capturers.begin(); jj!=capturers.end();jj++)
 		{
 			b_copy.lump_adj_lumps(*jj, HV, ENEMY, friends);
 		}
@@ -122,10 +122,10 @@ bool is_pass_alive(BoardState& b, int pos, vector<int>& codependants, ReadingLog
 		friends.erase(unique(friends.begin(), friends.end()), friends.end());
 
 		// Now friends is a list of lumps which must be pass-alive
-		for(vector<Lump*>::iterator jj=friends.begin(); jj!=friends.end();jj++)
+		for(vector<int>::iterator jj=friends.begin(); jj!=friends.end();jj++)
 		{
 			if(find(pcodependants.begin(),pcodependants.end(),*jj)!=pcodependants.end()) continue;
-			if(!is_pass_alive(b_copy, (*jj)->stones[0], store_codeps, log))return false;
+			if(!is_pass_alive(b_copy, b_copy.lump_stone[*jj], store_codeps, log))return false;
 		}		
 	}
 	return true;
@@ -161,12 +161,12 @@ int get_status_in_box(BoardState& bd, vector<int> targets, int left, int right,
 	// Add the specified extras
 	inv.insert(inv.end(), extra_border.begin(), extra_border.end());
 	// Add any friendly groups with no liberties inside the box
-	vector<Lump*> store;
+	vector<int> store;
 	for(int i = left+1;i<right;i++)
 	{
 		for(int j = top+1;j<bottom;j++)
 		{
-			if(bd.board[i + j*bd.board_size]!=NULL)
+			if(bd.board[i + j*bd.board_size]!=NO_LUMP)
 			{
 				if(!bd.has_libs_in_box(i + j*bd.board_size, left, right, top, bottom, extra_border)) store.push_back(bd.board[i + j*bd.board_size]);
 			}
@@ -175,22 +175,17 @@ int get_status_in_box(BoardState& bd, vector<int> targets, int left, int right,
 	sort(store.begin(), store.end());
 	store.erase(unique(store.begin(), store.end()), store.end());
 	// Now store contains a list of groups with no liberties in box. Add them to invincible stones.
-	for(vector<Lump*>::iterator ii=store.begin(); ii!=store.end();ii++)
+	for(vector<int>::iterator ii=store.begin(); ii!=store.end();ii++)
 	{
-		inv.insert(inv.end(), (*ii)->stones.begin(), (*ii)->stones.end());
+		bd.lump_stones(*ii, inv);
 	}
 	sort(inv.begin(), inv.end());
 	inv.erase(unique(inv.begin(), inv.end()), inv.end());
 
 	//Create new board with invincible stones on it
 	BoardState b(bd.board_size);
-	Lump* inv_lump = new Lump; // Will be destroyed with b, which is on the stack
 	int colour = bd.colour(targets[0]);
-	inv_lump->colour = bd.interpret_other_colour(colour);
-	inv_lump->liberties = 100;
-	inv_lump->stones=inv;
-	inv_lump->invincible=true;
-	for(vector<int>::iterator jj=inv_lump->stones.begin();jj!=inv_lump->stones.end();jj++) b.board[*jj]=inv_lump;
+	b.add_lump(inv, bd.interpret_other_colour(colour), true);
 
 	// Fill the box interior, and create list of empty spaces inside.
 	vector<int> eyespace;
@@ -199,7 +194,7 @@ int get_status_in_box(BoardState& bd, vector<int> targets, int left, int right,
 		for(int j = top+1;j<bottom;j++)
 		{
 			int pos = i + j*b.board_size;
-			if(b.board[pos]==NULL && bd.board[pos]!=NULL)
+			if(b.board[pos]==NO_LUMP && bd.board[pos]!=NO_LUMP)
 			{
 				if(b.to_move!=bd.colour(pos)) b.play_move(-1);
 				b.play_move(pos);
@@ -214,7 +209,7 @@ int get_status_in_box(BoardState& bd, vector<int> targets, int left, int right,
 	EyeGraph output;
 	log.addline("Computing eyespace...");
 	box_compute_eyespace(b, left, right, top, bottom, colour, output, log);
-	log.addline(output.display());
+	log.addline(output.display(b.board_size));
 
 	vector<int> vital_points;
 	int status = eval_eyespace_I(output, b.board_size, vital_points);
@@ -241,7 +236,7 @@ void box_compute_eyespace(BoardState& b, int left, int right, int top, int botto
 		for(int j = top+1;j<bottom;j++)
 		{
 			int pos = i + j*b.board_size;
-			if(b.board[pos]!=NULL) continue;
+			if(b.board[pos]!=NO_LUMP) continue;
 			// Discard definite false eyes
 			vector<int> store;
 			b.adj_points(pos, DIAG, store);
@@ -250,7 +245,7 @@ void box_compute_eyespace(BoardState& b, int left, int right, int top, int botto
 			for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 			{
 				// If two diagonal invincible stones (one on edge) then discard
-				if(b.board[*ii]!=NULL && b.colour(*ii)!=colour && b.board[*ii]->invincible) total++;
+				if(b.board[*ii]!=NO_LUMP && b.colour(*ii)!=colour && b.is_invincible(*ii)) total++;
 			}
 			if(total>=2) continue;
 			// Add to adj_spaces
@@ -260,7 +255,7 @@ void box_compute_eyespace(BoardState& b, int left, int right, int top, int botto
 			for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 			{
 				// If adjacent to a w stone, we don't want it
-				if(b.board[*ii]!=NULL && b.colour(*ii)!=colour) 
+				if(b.board[*ii]!=NO_LUMP && b.colour(*ii)!=colour) 
 				{
 					output.adj_spaces.push_back(pos);
 					flag=true;
@@ -274,13 +269,15 @@ void box_compute_eyespace(BoardState& b, int left, int right, int top, int botto
 	}
 	// Now eyespace contains all liberties where we could possibly end up with an eye
 	// Add all non-invincible enemy stones in the box (finding their status is expensive)
-	vector<Lump*> all_lumps;
+	vector<int> all_lumps;
 	b.all_lumps(all_lumps);
-	for(vector<Lump*>::iterator ii=all_lumps.begin();ii!=all_lumps.end();ii++)
+	for(vector<int>::iterator ii=all_lumps.begin();ii!=all_lumps.end();ii++)
 	{
-		if((*ii)->colour!=colour && !(*ii)->invincible)
+		if(b.lump_colour[*ii]!=colour && !b.lump_invincible[*ii])
 		{
-			output.all_enemy_stones.push_back((*ii)->stones);
+			vector<int> stones;
+			b.lump_stones(*ii, stones);
+			output.all_enemy_stones.push_back(stones);
 		}
 	}
 
@@ -24,7 +24,7 @@ public:
 	std::vector<int> three_nb;
 	std::vector<int> four_nb;
 
-	std::string display();
+	std::string display(int board_size);
 };
 
 bool is_pass_alive(BoardState& b, int pos, std::vector<int>& codependants, ReadingLog& log);
@@ -9,35 +9,158 @@
 #include "board.h"
 #include "globals.h"
 #include "reading.h"
+#include "dfpn.h"
+#include "lambda.h"
+#include "threadpool.h"
 
 using namespace std;
 
-// Gets status of target group. Returns ALIVE, DEAD or UNSETTLED and outputs to vectors as necessary.
+// can_capture and can_escape, from whichever solver settings picks. The df-pn solver's answer is
+// "not captured" if it gives up.
+static bool solve_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	if(settings.solver==DFPN_SOLVER) return dfpn_capture(b, target, settings, log).status==DEAD;
+	if(settings.solver==LAMBDA_SOLVER) return lambda_capture(b, target, depth, settings, log);
+	return can_capture(b, target, depth, settings, log);
+}
+static bool solve_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	if(settings.solver==DFPN_SOLVER) return dfpn_escape(b, target, settings, log).status==ALIVE;
+	if(settings.solver==LAMBDA_SOLVER) return lambda_escape(b, target, depth, settings, log);
+	return can_escape(b, target, depth, settings, log);
+}
+
+// A loop of moves read in parallel, as tasks in the reading pool (see read_in_parallel). Each task plays
+// its move on its own copy of the board and reads on with its own log; the table is shared, which is
+// safe. results[i] is 1 if the target is captured after moves[i], 0 if not, and -1 if the task was
+// cancelled or ran out of budget. With stop_early, the first task to find a capture (attacking) or an
+// escape (not) cancels the rest, since that settles the loop.
+class ParallelLoop: public TaskBatch
+{
+public:
+	ParallelLoop(BoardState& b, int target, int depth, bool attacking, const vector<int>& moves, bool stop_early, ReadingSettings& settings, ReadingLog& log):
+		b(b), target(target), depth(depth), attacking(attacking), moves(moves), stop_early(stop_early), settings(settings), log(log),
+		results(moves.size(), -1), task_moves(moves.size(), 0), task_unproven(moves.size(), 0), touched(moves.size())
+	{
+		shared.moves=log.total_moves;
+		shared.cancelled=false;
+		shared.parent=log.shared;
+		for(size_t i=0;i<touched.size();i++) touched[i].clear();
+	}
+	// The copy is on the heap: a thread waiting in the pool runs other tasks on top of its own stack
+	void run_task(int i)
+	{
+		if(shared.any_cancelled()) return;
+		BoardState* copy=new BoardState(b);
+		copy->touched.clear();
+		ReadingLog task_log(log, &shared);
+		copy->play_move(moves[i]);
+		bool captured=read(*copy, task_log);
+		task_moves[i]=task_log.total_moves;
+		task_unproven[i]=task_log.unproven;
+		touched[i]=copy->touched;
+		delete copy;
+		if(task_log.stopped) return;
+		results[i]=(captured ? 1 : 0);
+		if(stop_early && captured==attacking) shared.cancelled=true;
+	}
+	// Whether the target is captured, reading on from the position after the task's move
+	virtual bool read(BoardState& copy, ReadingLog& task_log)=0;
+	BoardState& b;
+	int target;
+	int depth;
+	bool attacking;
+	const vector<int>& moves;
+	bool stop_early;
+	ReadingSettings& settings;
+	ReadingLog& log;
+	SharedReading shared;
+	vector<int> results;
+	vector<int> task_moves;
+	vector<int> task_unproven;
+	vector<Box> touched; // The moves each task played (see RegionGuard)
+private:
+	ParallelLoop& operator=(const ParallelLoop&);
+};
+
+// Runs loop, adding its tasks' nodes to log, and the moves they played to b.touched. Unless a task
+// settled the loop, one that did not finish leaves the loop's answer unknown, and log is stopped.
+static void read_in_parallel(ParallelLoop& loop, ReadingSettings& settings, ReadingLog& log, vector<int>& results)
+{
+	log.addline("Reading "); log.addint(loop.moves.size()); log.add(" moves in parallel");
+	reading_pool(settings.threads).run(loop, (int)loop.moves.size());
+	bool settled=loop.shared.cancelled;
+	for(size_t i=0;i<loop.moves.size();i++)
+	{
+		log.total_moves+=loop.task_moves[i];
+		log.unproven+=loop.task_unproven[i];
+		loop.b.touched.add(loop.touched[i]);
+		if(loop.results[i]==-1 && !settled) log.stopped=true;
+	}
+	results.swap(loop.results);
+}
+
+// Root splitting: the moves of one loop in status_at_depth, answered with solve_escape (attacking
+// moves) or solve_capture (escaping moves), to depth, with whichever solver settings picks.
+class RootSplit: public ParallelLoop
+{
+public:
+	RootSplit(BoardState& b, int target, int depth, bool attacking, const vector<int>& moves, bool stop_early, ReadingSettings& settings, ReadingLog& log):
+		ParallelLoop(b, target, depth, attacking, moves, stop_early, settings, log){}
+	bool read(BoardState& copy, ReadingLog& task_log)
+	{
+		if(attacking) return copy.board[target]==NO_LUMP || !solve_escape(copy, target, depth, settings, task_log);
+		return solve_capture(copy, target, depth, settings, task_log);
+	}
+};
+
+// Gets status of target group, reading to depth. Returns ALIVE, DEAD or UNSETTLED and outputs to vectors as necessary.
 // If get_defences is false, no escape moves will be produced (and result will be ALIVE or DEAD)
 // If either output pointer is NULL, nothing will be sent there and the function will return as soon as
 // it can be sure of an ALIVE/DEAD result
-int get_status(BoardState& b, int target, bool get_defences, vector<int>* capture_here, vector<int>* escape_here, ReadingSettings& settings, ReadingLog& log)
+// Reads in place on b: every move played is undone before returning. If the budget runs out
+// (log.stopped), the result means nothing.
+static int status_at_depth(BoardState& b, int target, bool get_defences, vector<int>* capture_here, vector<int>* escape_here, int depth, ReadingSettings& settings, ReadingLog& log)
 {
-	assert(b.board[target]!=NULL);
+	assert(b.board[target]!=NO_LUMP);
 	log.addline("Calling get_status on "); log.addpos(target);
-	if(b.board[target]->invincible) return ALIVE;
+	if(b.is_invincible(target)) return ALIVE;
 	bool something_captures=false;
 	bool something_escapes=false;
 	vector<int> store;
-	BoardState b_copy = b;
-	// Insert pass if we're trying to capture our own stones
-	if(b_copy.to_move==b_copy.colour(target)){b_copy.play_move(-1);}
+	UndoGuard guard(b);
 	// Can escape early if ladderable and we don't want to record capturing moves
+	// (is_ladderable makes its own colour correction)
 	if(capture_here==NULL && is_ladderable(b, target, NULL, log))
 	{
 		something_captures=true;
+		if(b.to_move==b.colour(target)){b.play_move(-1);}
 	} else {
-		capture_moves(b_copy, target, settings.reading_depth, store, log);
+		// Insert pass if we're trying to capture our own stones
+		if(b.to_move==b.colour(target)){b.play_move(-1);}
+		capture_moves(b, target, depth, store, log);
+		vector<int> split;
+		if(settings.threads>1 && store.size()>1 && log.shared==NULL)
+		{
+			RootSplit loop(b, target, depth, true, store, capture_here==NULL, settings, log);
+			read_in_parallel(loop, settings, log, split);
+			if(log.stopped) return ALIVE;
+		}
 		for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 		{
-			BoardState b_copy2 = b_copy;
-			b_copy2.play_move(*ii);
-			if(b_copy2.board[target]==NULL || can_escape(b_copy2, target, settings.reading_depth, settings, log)==false)
+			bool captured;
+			if(!split.empty())
+			{
+				int result=split[ii-store.begin()];
+				if(result==-1) continue;
+				captured=(result==1);
+			} else {
+				b.play_move(*ii);
+				captured = (b.board[target]==NO_LUMP || solve_escape(b, target, depth, settings, log)==false);
+				b.undo_move();
+				if(log.stopped) return ALIVE;
+			}
+			if(captured)
 			{
 				if(capture_here==NULL)
 				{
@@ -61,14 +184,31 @@ int get_status(BoardState& b, int target, bool get_defences, vector<int>* captur
 	}
 
 	store.clear();
-	b_copy.play_move(-1);
-	escape_moves(b_copy, target, settings.reading_depth, store, log);
+	b.play_move(-1);
+	escape_moves(b, target, depth, store, log);
+	vector<int> split;
+	if(settings.threads>1 && store.size()>1 && log.shared==NULL)
+	{
+		RootSplit loop(b, target, depth, false, store, escape_here==NULL, settings, log);
+		read_in_parallel(loop, settings, log, split);
+		if(log.stopped) return ALIVE;
+	}
 	
 	for(vector<int>::iterator ii=store.begin();ii!=store.end();ii++)
 	{
-		BoardState b_copy2 = b_copy;
-		b_copy2.play_move(*ii);
-		if(can_capture(b_copy2, target, settings.reading_depth, settings, log)==false)
+		bool captured;
+		if(!split.empty())
+		{
+			int result=split[ii-store.begin()];
+			if(result==-1) continue;
+			captured=(result==1);
+		} else {
+			b.play_move(*ii);
+			captured = solve_capture(b, target, depth, settings, log);
+			b.undo_move();
+			if(log.stopped) return ALIVE;
+		}
+		if(captured==false)
 		{
 			if(escape_here==NULL)
 			{
@@ -83,48 +223,178 @@ int get_status(BoardState& b, int target, bool get_defences, vector<int>* captur
 	if(something_escapes) return UNSETTLED;
 	else return DEAD;
 }
+
+static bool has_budget(ReadingSettings& settings, ReadingLog& log)
+{
+	return settings.node_budget!=0 || log.has_deadline;
+}
+
+int get_status(BoardState& b, int target, bool get_defences, vector<int>* capture_here, vector<int>* escape_here, ReadingSettings& settings, ReadingLog& log)
+{
+	if(has_budget(settings, log) && settings.solver!=DFPN_SOLVER) return read_status(b, target, get_defences, capture_here, escape_here, settings, log).status;
+	return status_at_depth(b, target, get_defences, capture_here, escape_here, settings.reading_depth, settings, log);
+}
+
+// Gives one iterative deepening read its node budget, and clears log.stopped for the next read when it is done
+class BudgetGuard
+{
+public:
+	BudgetGuard(ReadingSettings& settings, ReadingLog& l): log(l)
+	{
+		log.node_limit=(settings.node_budget==0 ? 0 : log.total_moves+settings.node_budget);
+		log.stopped=(log.has_deadline && chrono::steady_clock::now()>=log.deadline);
+	}
+	~BudgetGuard()
+	{
+		log.node_limit=0;
+		log.stopped=false;
+	}
+private:
+	ReadingLog& log;
+	BudgetGuard& operator=(const BudgetGuard&);
+};
+
+// Each depth is read with the table holding what the one before found, so its best moves are tried
+// first and the deeper reads cost less than they would from cold.
+ReadResult read_status(BoardState& b, int target, bool get_defences, vector<int>* capture_here, vector<int>* escape_here, ReadingSettings& settings, ReadingLog& log)
+{
+	BudgetGuard budget(settings, log);
+	ReadResult out;
+	out.status=ALIVE;
+	out.depth=0;
+	out.proven=false;
+	vector<int> captures, escapes;
+	int unproven=log.unproven;
+	for(int depth=(settings.solver==DFPN_SOLVER ? settings.reading_depth : 1);depth<=settings.reading_depth;depth++)
+	{
+		captures.clear();
+		escapes.clear();
+		int status=status_at_depth(b, target, get_defences, (capture_here==NULL ? NULL : &captures), (escape_here==NULL ? NULL : &escapes), depth, settings, log);
+		if(log.stopped) break;
+		if(log.unproven!=unproven)
+		{
+			// A df-pn read gave up, so this is the best answer there is
+			out.status=status;
+			out.depth=depth;
+			if(capture_here!=NULL) *capture_here=captures;
+			if(escape_here!=NULL) *escape_here=escapes;
+			break;
+		}
+		out.status=status;
+		out.depth=depth;
+		if(capture_here!=NULL) *capture_here=captures;
+		if(escape_here!=NULL) *escape_here=escapes;
+		// DEAD is a capture with every escape captured too. Deeper reads could only add capturing moves.
+		if(depth==settings.reading_depth || (status==DEAD && capture_here==NULL))
+		{
+			out.proven=true;
+			break;
+		}
+	}
+	return out;
+}
+
+// As can_capture and can_escape (so with no colour correction)
+ReadResult read_capture(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log)
+{
+	BudgetGuard budget(settings, log);
+	if(settings.solver==DFPN_SOLVER) return dfpn_capture(b, target, settings, log);
+	ReadResult out;
+	out.status=ALIVE;
+	out.depth=0;
+	out.proven=false;
+	for(int depth=1;depth<=settings.reading_depth;depth++)
+	{
+		bool captured=solve_capture(b, target, depth, settings, log);
+		if(log.stopped) break;
+		out.status=(captured ? DEAD : ALIVE);
+		out.depth=depth;
+		if(captured || depth==settings.reading_depth)
+		{
+			out.proven=true;
+			break;
+		}
+	}
+	return out;
+}
+
+ReadResult read_escape(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log)
+{
+	BudgetGuard budget(settings, log);
+	if(settings.solver==DFPN_SOLVER) return dfpn_escape(b, target, settings, log);
+	ReadResult out;
+	out.status=ALIVE;
+	out.depth=0;
+	out.proven=false;
+	for(int depth=1;depth<=settings.reading_depth;depth++)
+	{
+		bool escaped=solve_escape(b, target, depth, settings, log);
+		if(log.stopped) break;
+		out.status=(escaped ? ALIVE : DEAD);
+		out.depth=depth;
+		if(!escaped || depth==settings.reading_depth)
+		{
+			out.proven=true;
+			break;
+		}
+	}
+	return out;
+}
 // If you pass an empty space as target, will play there with colour and then check.
 // Returns true if illegal move.
 bool get_capturable(BoardState& b, int target, int colour, ReadingSettings& settings, ReadingLog& log)
 {
-	if(b.board[target]!=NULL && b.board[target]->invincible) return false;
-	BoardState b_copy = b;
+	if(b.is_invincible(target)) return false;
+	UndoGuard guard(b);
 	// Play on empty space and check
-	if(b_copy.board[target]==NULL)
+	if(b.board[target]==NO_LUMP)
 	{
-		if(b_copy.to_move!=colour) b_copy.play_move(-1);
-		if(!b_copy.is_legal_move(target)) return true;
-		b_copy.play_move(target);
-		return can_capture(b_copy, target, settings.reading_depth, settings, log);
+		if(b.to_move!=colour) b.play_move(-1);
+		if(!b.is_legal_move(target)) return true;
+		b.play_move(target);
+	} else {
+		// Otherwise, correct for colour and then check
+		if(b.to_move==b.colour(target)){b.play_move(-1);}
 	}
-	// Otherwise, correct for colour and then check
-	if(b_copy.to_move==b_copy.colour(target)){b_copy.play_move(-1);}
-	return can_capture(b_copy, target, settings.reading_depth, settings, log);
+	if(has_budget(settings, log)) return read_capture(b, target, settings, log).status==DEAD;
+	return solve_capture(b, target, settings.reading_depth, settings, log);
 }
 
-// Returns true/false. Also outputs which of the two liberties works, if output!=NULL
-bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log)
+// (Only the last few moves are compared, so hash collisions don't matter in practice)
+bool is_repetition(BoardState& b, size_t start)
+{
+	for(size_t i=b.history.size();i>=start+2;i-=2)
+	{
+		if(b.history[i-2].hash_value==b.hash_value) return true;
+	}
+	return false;
+}
+
+// is_ladderable, for a ladder that started when b's history was start moves long. When the defender
+// captures, a ladder can come round to the same position again (this happens on big boards); the
+// defender can keep that up forever, so it counts as an escape.
+static bool read_ladder(BoardState& b, int pos, vector<int>* output, ReadingLog& log, size_t start)
 {
 	assert(pos>=0);
-	Lump* target = bd.board[pos];
-	if(target->invincible) return false;
+	int target = b.board[pos];
+	if(b.lump_invincible[target]) return false;
 
-	if(target->liberties==1) return true;
-	if(target->liberties>2) return false;
+	if(b.lump_liberties[target]==1) return true;
+	if(b.lump_liberties[target]>2) return false;
+	if(is_repetition(b, start)) return false;
 
-	BoardState b = bd;
+	UndoGuard guard(b);
 	if(b.to_move==b.colour(pos)) {b.play_move(-1);}
 	assert(b.to_move!=b.colour(pos));
 
 	vector<int> libs;
-	b.lump_adj_liberties(pos, HV, libs);
+	b.lump_adj_liberties(target, HV, libs);
 	// Put most promising lib first
 	int tmp;
 	// If one possible move has fewer liberties than the other, play the other one first
 	if(b.n_adj_liberties(libs[0], HV)<b.n_adj_liberties(libs[1],HV)){tmp=libs[0];libs[0]=libs[1];libs[1]=tmp;}
 	// Also try the first line last
-	else if(libs[0]%b.board_size ==0 || libs[0]%b.board_size==b.board_size-1){tmp=libs[0];libs[0]=libs[1];libs[1]=tmp;}
-	else if(((int)libs[0]/b.board_size) ==0 || ((int)libs[0]/b.board_size)==b.board_size-1){tmp=libs[0];libs[0]=libs[1];libs[1]=tmp;}
+	else if(b.neighbours(libs[0]).n_hv<4){tmp=libs[0];libs[0]=libs[1];libs[1]=tmp;}
 
 	// Check no of libs for each possible place, play highest 1st
 	
@@ -133,14 +403,14 @@ bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log
 	bool lib1legal = b.is_legal_move(libs[1]);
 	if(lib0legal==false && lib1legal==false) {return false;}
 
-	vector<Lump*> adj_friends;
-	b.lump_adj_lumps(pos, HV, b.interpret_other_colour(target->colour), adj_friends);
+	vector<int> adj_friends;
+	b.lump_adj_lumps(target, HV, b.interpret_other_colour(b.lump_colour[target]), adj_friends);
 
 	vector<int> capture_move;
 	// Fill this with moves that capture surrounding stones
-	for(vector<Lump*>::iterator ii = adj_friends.begin();ii!=adj_friends.end();ii++)
+	for(vector<int>::iterator ii = adj_friends.begin();ii!=adj_friends.end();ii++)
 	{
-		if((*ii)->liberties==1)
+		if(b.lump_liberties[*ii]==1)
 		{
 			b.lump_adj_liberties(*ii, HV, capture_move);
 		}
@@ -154,21 +424,22 @@ bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log
 	//First try lib0 and capturing
 	if(lib0legal && (capture_move.size()>0))
 	{
-		BoardState b_copy = b;
-		assert(b_copy.to_move!=b_copy.colour(pos));
-		b_copy.play_move(libs[0]);
+		assert(b.to_move!=b.colour(pos));
+		b.play_move(libs[0]);
 
-		if(b_copy.is_legal_move(capture_move[0]))
+		if(b.is_legal_move(capture_move[0]))
 		{
-			b_copy.play_move(capture_move[0]);
-			if(is_ladderable(b_copy, pos, NULL, log))
+			b.play_move(capture_move[0]);
+			if(read_ladder(b, pos, NULL, log, start))
 			{
 				// This escape fails
 			} else {
 				// Capture escapes and lib0 fails
 				lib0legal=false;
 			}
+			b.undo_move();
 		}
+		b.undo_move();
 	}
 
 
@@ -177,36 +448,37 @@ bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log
 	// Either capturing fails or wasn't possible, so try lib0 and escape by extending
 	if(lib0legal)
 	{
-		BoardState b_copy = b;
-		assert(b_copy.to_move!=b_copy.colour(pos));
-		b_copy.play_move(libs[0]);
+		assert(b.to_move!=b.colour(pos));
+		b.play_move(libs[0]);
 
 		// If newly-played move is in atari, try capturing it
-		if(b_copy.liberties(libs[0])==1)
+		if(b.liberties(libs[0])==1)
 		{
 			vector<int> store;
-			b_copy.lump_adj_liberties(libs[0], HV, store);
-			if(b_copy.is_legal_move(store[0]))
+			b.lump_adj_liberties(b.board[libs[0]], HV, store);
+			if(b.is_legal_move(store[0]))
 			{
-				BoardState b_copy2 = b_copy;
-				b_copy2.play_move(store[0]);
-				if(is_ladderable(b_copy2, pos, NULL, log)==false)
+				b.play_move(store[0]);
+				if(read_ladder(b, pos, NULL, log, start)==false)
 				{// Capturing lib0 escapes, and lib0 fails.
 					lib0legal=false;
 				}
+				b.undo_move();
 			}
 		}
 
 		if(lib0legal)
-		{if(b_copy.is_legal_move(libs[1]))
+		{if(b.is_legal_move(libs[1]))
 		{
-			b_copy.play_move(libs[1]);
-			lib0wins = is_ladderable(b_copy, pos, NULL, log);
+			b.play_move(libs[1]);
+			lib0wins = read_ladder(b, pos, NULL, log, start);
+			b.undo_move();
 		} else {
 			// Can't play other liberty to escape, so lib0 captures
 			lib0wins=true;
 		}
 		}
+		b.undo_move();
 	}
 
 
@@ -215,54 +487,56 @@ bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log
 	// First try lib1 and capture
 	if(lib1legal && (capture_move.size()>0))
 	{
-		BoardState b_copy = b;
-		assert(b_copy.to_move!=b_copy.colour(pos));
-		b_copy.play_move(libs[1]);
+		assert(b.to_move!=b.colour(pos));
+		b.play_move(libs[1]);
 
-		if(lib1legal && b_copy.is_legal_move(capture_move[0]))
+		if(lib1legal && b.is_legal_move(capture_move[0]))
 		{
-			b_copy.play_move(capture_move[0]);
-			if(is_ladderable(b_copy, pos, NULL, log))
+			b.play_move(capture_move[0]);
+			if(read_ladder(b, pos, NULL, log, start))
 			{
 				// This escape fails
 			} else {
 				// Capture escapes and lib0 fails
 				lib1legal=false;
 			}
+			b.undo_move();
 		}
+		b.undo_move();
 	}
 
 	if(lib1legal)
 	{
-		BoardState b_copy = b;
-		assert(b_copy.to_move!=b_copy.colour(pos));
-		b_copy.play_move(libs[1]);
+		assert(b.to_move!=b.colour(pos));
+		b.play_move(libs[1]);
 
 		// If newly-played move is in atari, try capturing it
-		if(b_copy.liberties(libs[1])==1)
+		if(b.liberties(libs[1])==1)
 		{
 			vector<int> store2;
-			b_copy.lump_adj_liberties(libs[1], HV, store2);
-			if(b_copy.is_legal_move(store2[0]))
+			b.lump_adj_liberties(b.board[libs[1]], HV, store2);
+			if(b.is_legal_move(store2[0]))
 			{
-				BoardState b_copy2 = b_copy;
-				b_copy2.play_move(store2[0]);
-				if(is_ladderable(b_copy2, pos, NULL, log)==false)
+				b.play_move(store2[0]);
+				if(read_ladder(b, pos, NULL, log, start)==false)
 				{// Capturing lib1 escapes, and lib1 fails.
 					lib1legal=false;
 				}
+				b.undo_move();
 			}
 		}
 		if(lib1legal)
-		{if(b_copy.is_legal_move(libs[0]))
+		{if(b.is_legal_move(libs[0]))
 		{
-			b_copy.play_move(libs[0]);
-			lib1wins = is_ladderable(b_copy, pos, NULL, log);
+			b.play_move(libs[0]);
+			lib1wins = read_ladder(b, pos, NULL, log, start);
+			b.undo_move();
 		} else {
 			// Can't play other liberty to escape, so lib0 captures
 			lib1wins=true;
 		}
 		}
+		b.undo_move();
 	}
 
 	if(output!=NULL)
@@ -274,51 +548,231 @@ bool is_ladderable(BoardState& bd, int pos, vector<int>* output, ReadingLog& log
 	else return true;
 }
 
-bool is_ladderable(BoardState& b, Lump& target, vector<int>* output, ReadingLog& log)
+// Returns true/false. Also outputs which of the two liberties works, if output!=NULL
+// Reads in place on b: every move played is undone before returning.
+bool is_ladderable(BoardState& b, int pos, vector<int>* output, ReadingLog& log)
 {
-	return is_ladderable(b, target.stones[0], output, log);
+	return read_ladder(b, pos, output, log, b.history.size());
 }
 
 // Takes a lump in atari, returns true if it is laddered.
-bool is_laddered(BoardState& bd, int pos, ReadingLog& log)
+// Reads in place on b: every move played is undone before returning.
+bool is_laddered(BoardState& b, int pos, ReadingLog& log)
 {
-	if(bd.liberties(pos)!=1 || bd.board[pos]->invincible) return false;
+	if(b.liberties(pos)!=1 || b.is_invincible(pos)) return false;
 	
-	BoardState b = bd;
+	UndoGuard guard(b);
 	if(b.to_move!=b.colour(pos)) b.play_move(-1);
 	
 	vector<int> store;
-	vector<Lump*> adj_enemies;
-	b.lump_adj_lumps(pos, HV, ENEMY, adj_enemies);
-	for(vector<Lump*>::iterator ii = adj_enemies.begin(); ii!=adj_enemies.end(); ii++)
+	vector<int> adj_enemies;
+	b.lump_adj_lumps(b.board[pos], HV, ENEMY, adj_enemies);
+	for(vector<int>::iterator ii = adj_enemies.begin(); ii!=adj_enemies.end(); ii++)
 	{
-		if((*ii)->liberties==1) b.lump_adj_liberties(*ii, HV, store);
+		if(b.lump_liberties[*ii]==1) b.lump_adj_liberties(*ii, HV, store);
 	}
-	b.lump_adj_liberties(pos, HV, store);
+	b.lump_adj_liberties(b.board[pos], HV, store);
 	// Now store contains the one liberty and all adjacent captures.
 	// Iterate and see whether any of them escape
 	for(vector<int>::iterator ii = store.begin();ii!=store.end();ii++)
 	{
 		if(b.is_legal_move(*ii))
 		{
-			BoardState b_copy = b;
-			b_copy.play_move(*ii);
-			if(is_ladderable(b_copy, pos, NULL, log)==false) return false;
+			b.play_move(*ii);
+			bool escapes = (is_ladderable(b, pos, NULL, log)==false);
+			b.undo_move();
+			if(escapes) return false;
 		}
 	}
 	return true;
 }
 
+// Moves move (if it is in the list) to the front, leaving the others in order. Used to try the
+// move stored in the hash table, which proved the result last time, before anything else.
+static void try_first(vector<int>& move_list, int move)
+{
+	vector<int>::iterator ii=find(move_list.begin(), move_list.end(), move);
+	if(ii!=move_list.end()) rotate(move_list.begin(), ii, ii+1);
+}
+
+// A result that only depends on the stones near the target is stored against those stones alone (see
+// hashing.cpp), so that it is found again after moves elsewhere on the board. The region of a query is
+// a box REGION_MARGIN points bigger than the target lump, grown until the ring of points around it
+// holds no stones. Then every lump in the box is wholly inside it, with its liberties inside or on
+// the ring, and so is every lump next to one of them. The result is good for the region if the
+// search played nothing (b.touched) outside the box. A result found in the table counts as moves all
+// over its own region (so that a node can only rely on it if that region is inside its own), or over
+// the whole board if it was not region-local.
+const int REGION_MARGIN = 3;
+
+// Works out the region of one node of the search and looks after b.touched for it: the moves played
+// below the node are added to those played before it when it returns. The region is left in
+// b.guard_region for the node below, which can often keep it as it is.
+template<class Hash> class RegionGuard
+{
+public:
+	RegionGuard(BoardState& b, Hash& h, int target);
+	~RegionGuard()
+	{
+		board.touched.add(outer);
+		board.guard_region=outer_region;
+		board.guard_target=outer_target;
+		board.guard_moves=outer_moves;
+	}
+	int query_hash(bool want_capturable, int target, int depth, int* move);
+	void insert_hash(bool want_capturable, int target, int depth, bool result, int move=-1);
+private:
+	BoardState& board;
+	Hash& hash;
+	Box outer; // b.touched from before the node
+	Box outer_region; // And b.guard_region, guard_target and guard_moves
+	int outer_target;
+	int outer_moves;
+	Box region;
+	bool local; // False if the region is the whole board
+	RegionGuard& operator=(const RegionGuard&);
+};
+
+// With no table there is nothing to look up or store, so no region to work out
+template<> class RegionGuard<NullHash>
+{
+public:
+	RegionGuard(BoardState& b, NullHash& h, int target){}
+	int query_hash(bool want_capturable, int target, int depth, int* move)
+	{
+		if(move!=NULL) *move=-1;
+		return UNSETTLED;
+	}
+	void insert_hash(bool want_capturable, int target, int depth, bool result, int move=-1){}
+};
+
+template<class Hash> RegionGuard<Hash>::RegionGuard(BoardState& b, Hash& h, int target): board(b), hash(h), outer(b.touched),
+	outer_region(b.guard_region), outer_target(b.guard_target), outer_moves(b.guard_moves)
+{
+	int n=b.board_size-1;
+	region=b.lump_box[b.board[target]];
+	region.add(max(region.left-REGION_MARGIN, 0), max(region.top-REGION_MARGIN, 0));
+	region.add(min(region.right+REGION_MARGIN, n), min(region.bottom+REGION_MARGIN, n));
+	// Growing only ever adds lumps, so the region of the node above is still the region if the one move
+	// since was a pass, or captured nothing and left the lump it joined inside that region (with the
+	// margin around the target): no other lump has changed.
+	bool reuse=false;
+	if(b.guard_moves!=-1 && b.guard_target==target && b.guard_moves+1==(int)b.history.size() && b.guard_region.contains(region))
+	{
+		const UndoRecord& last=b.history.back();
+		reuse=(last.pos==-1 || (last.n_captured==0 && b.guard_region.contains(b.lump_box[b.board[last.pos]])));
+	}
+	if(reuse)
+	{
+		region=b.guard_region;
+	} else {
+		// Take in every lump whose box comes within a point of the region, until none is left that does
+		// (or the region is the whole board)
+		bool grown=true;
+		while(grown && (region.left!=0 || region.top!=0 || region.right!=n || region.bottom!=n))
+		{
+			grown=false;
+			Box near=region;
+			near.add(region.left-1, region.top-1);
+			near.add(region.right+1, region.bottom+1);
+			for(int i=0;i<b.n_lumps;i++)
+			{
+				const Box& box=b.lump_box[b.live_lumps[i]];
+				if(!near.meets(box) || region.contains(box)) continue;
+				region.add(box);
+				grown=true;
+			}
+		}
+	}
+	local=(region.left!=0 || region.top!=0 || region.right!=n || region.bottom!=n);
+	b.guard_region=region;
+	b.guard_target=target;
+	b.guard_moves=(int)b.history.size();
+	b.touched.clear();
+}
+
+// The region-local result if there is one, then the result for the whole position. A move stored
+// with either is handed back.
+template<class Hash> int RegionGuard<Hash>::query_hash(bool want_capturable, int target, int depth, int* move)
+{
+	int region_move=-1;
+	if(local)
+	{
+		int result=hash.query_hash(board, want_capturable, target, depth, &region_move, &region);
+		if(result!=UNSETTLED)
+		{
+			board.touched.add(region);
+			if(move!=NULL) *move=region_move;
+			return result;
+		}
+	}
+	int result=hash.query_hash(board, want_capturable, target, depth, move);
+	if(result!=UNSETTLED)
+	{
+		board.touched.add(0, 0);
+		board.touched.add(board.board_size-1, board.board_size-1);
+	}
+	if(move!=NULL && *move==-1) *move=region_move;
+	return result;
+}
+
+template<class Hash> void RegionGuard<Hash>::insert_hash(bool want_capturable, int target, int depth, bool result, int move)
+{
+	bool stayed_inside=local && region.contains(board.touched);
+	hash.insert_hash(board, want_capturable, target, depth, result, move, stayed_inside ? &region : NULL);
+}
+
+template<class Hash> static bool can_capture(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log);
+template<class Hash> static bool can_escape(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log);
+
+// Young brothers wait. With threads, a node of can_capture or can_escape at split_depth or more reads
+// its first move (the table's move, if it has one) alone, since that move usually settles the node.
+// If it does not, the rest are worth reading, and if there are at least split_moves of them they are
+// read as a parallel loop: any thread with nothing to do steals one, and splits it further in turn.
+// The first to settle the node cancels the others, and every loop they have started. Fewer moves, or
+// shallower subtrees, are read in turn, as they are not worth a board copy and a task each.
+template<class Hash> class SiblingSplit: public ParallelLoop
+{
+public:
+	SiblingSplit(BoardState& b, Hash& h, int target, int depth, bool attacking, const vector<int>& moves, ReadingSettings& settings, ReadingLog& log):
+		ParallelLoop(b, target, depth, attacking, moves, true, settings, log), hash(h){}
+	bool read(BoardState& copy, ReadingLog& task_log)
+	{
+		if(attacking) return !can_escape(copy, hash, target, depth, settings, task_log);
+		return can_capture(copy, hash, target, depth, settings, task_log);
+	}
+private:
+	Hash& hash;
+};
+
+// Whether the node should read the moves from ii on in parallel
+static bool split_here(vector<int>::const_iterator ii, const vector<int>& move_list, int depth, ReadingSettings& settings)
+{
+	return settings.threads>1 && depth>=settings.split_depth && ii!=move_list.begin() && move_list.end()-ii>=max(settings.split_moves, 2);
+}
+
+// Reads the moves from ii on as a SiblingSplit, to depth. Returns one that settles the node, or -1.
+template<class Hash> static int read_siblings(BoardState& b, Hash& h, int target, int depth, bool attacking, vector<int>::const_iterator ii, const vector<int>& move_list, ReadingSettings& settings, ReadingLog& log)
+{
+	vector<int> moves(ii, move_list.end());
+	SiblingSplit<Hash> loop(b, h, target, depth, attacking, moves, settings, log);
+	vector<int> results;
+	read_in_parallel(loop, settings, log, results);
+	if(log.stopped) return -1;
+	for(size_t i=0;i<moves.size();i++) if(results[i]==(attacking ? 1 : 0)) return moves[i];
+	return -1;
+}
+
 // Returns true if lump at board position target can be captured after playing
 // at most depth moves.
-bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+template<class Hash> static bool can_capture(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log)
 {
 	log.addline("Trying to capture in this position");
 	log.addboard(b);
-	assert(b.board[target]!=NULL);
+	assert(b.board[target]!=NO_LUMP);
 
 	// Perform obvious checks
-	if(b.board[target]->invincible) return false;
+	if(b.is_invincible(target)) return false;
 	int target_libs=b.liberties(target);
 	if(target_libs==1) {log.addline("...returning true (in atari)"); return true;}
 	if((target_libs>depth))
@@ -331,7 +785,9 @@ bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings
 	}
 
 	// Check hash table
-	int hash_result = b.hash->query_hash(b, true, target, depth);
+	RegionGuard<Hash> region(b, h, target);
+	int hash_move;
+	int hash_result = region.query_hash(true, target, depth, &hash_move);
 	if(hash_result==DEAD)
 	{
 		log.addline("This position is in the hash table - capturable.");
@@ -346,7 +802,7 @@ bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings
 	if(is_ladderable(b, target, NULL, log)) 
 	{
 		log.addline("...returning true (ladderable)"); 
-		b.hash->insert_hash(b, true, target, depth, true);
+		region.insert_hash(true, target, depth, true);
 		return true;
 	} else if(target_libs==2 && depth<2)
 	{
@@ -357,55 +813,67 @@ bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings
 	// Fill move list and trim it if too large
 	vector<int> move_list;
 	capture_moves(b, target, depth, move_list, log);
+	try_first(move_list, hash_move);
 	if(static_cast<int>(move_list.size())>settings.branch_limit)
 	{
 		move_list.erase(move_list.begin()+settings.branch_limit, move_list.end());
 	}
 
-	// For each move on list, create copy, play move, ask about escaping.
+	// For each move on list, play move, ask about escaping, undo.
 	// Also decrement depth
 
     log.total_moves++;
+	if(log.out_of_budget()) return false;
 	for(vector<int>::iterator ii=move_list.begin();ii!=move_list.end();ii++)
 	{
-		BoardState b_copy = b;
-		assert(b_copy.is_legal_move(*ii));
-		b_copy.play_move(*ii);
+		if(split_here(ii, move_list, depth, settings))
+		{
+			int move=read_siblings(b, h, target, depth-1, true, ii, move_list, settings, log);
+			if(log.stopped) return false;
+			region.insert_hash(true, target, depth, move!=-1, move);
+			return move!=-1;
+		}
+		assert(b.is_legal_move(*ii));
+		b.play_move(*ii);
 
 		log.current_depth++;
-		bool result = can_escape(b_copy, target, depth-1, settings, log);
+		bool result = can_escape(b, h, target, depth-1, settings, log);
 		log.current_depth--;
+		b.undo_move();
 
+		if(log.stopped) return false; // The answer below is no good, so store nothing
 		if(result==false)
 		{
-			b.hash->insert_hash(b, true, target, depth, true);
+			region.insert_hash(true, target, depth, true, *ii);
 			return true;
 		}
 	}
 
 	// If we tried all capturing moves and none worked, return false
-	b.hash->insert_hash(b, true, target, depth, false);
+	region.insert_hash(true, target, depth, false);
 	return false;
 }
 
 // Returns false if lump at board position target can be captured when opponent
 // plays depth non-atari moves.
-bool can_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+template<class Hash> static bool can_escape(BoardState& b, Hash& h, int target, int depth, ReadingSettings& settings, ReadingLog& log)
 
 {
 	log.addline("Trying to escape");
 	log.addboard(b);
-	assert(b.board[target]!=NULL);
+	assert(b.board[target]!=NO_LUMP);
 
 	// Perform obvious checks
-	if(b.board[target]->invincible) return true;
+	if(b.is_invincible(target)) return true;
 	if(b.liberties(target)>=settings.escape_libs)
 	{
 		return true;
 	}
 
 	// Check hash table
-	int hash_result = b.hash->query_hash(b, false, target, depth);
+	RegionGuard<Hash> region(b, h, target);
+	int hash_move;
+	int hash_result = region.query_hash(false, target, depth, &hash_move);
 	if(hash_result==DEAD)
 	{
 		log.addline("This position is in the hash table - capturable.");
@@ -421,7 +889,7 @@ bool can_escape(BoardState& b, int target, int depth, ReadingSettings& settings,
 	{
 		if(is_laddered(b, target, log)) 
 		{
-			b.hash->insert_hash(b, false, target, depth, false);
+			region.insert_hash(false, target, depth, false);
 			return false;
 		}
 	}
@@ -429,38 +897,62 @@ bool can_escape(BoardState& b, int target, int depth, ReadingSettings& settings,
 	// Fill move list
 	vector<int> move_list;
 	escape_moves(b, target, depth, move_list, log);
+	try_first(move_list, hash_move);
 	if(static_cast<int>(move_list.size())>settings.branch_limit)
 	{
 		move_list.erase(move_list.begin()+settings.branch_limit, move_list.end());
 	}
 
 	log.total_moves++;
+	if(log.out_of_budget()) return true;
 
-	// For each move on list, create copy, play move, ask about escaping.
+	// For each move on list, play move, ask about capturing, undo.
 	// If not atari, also decrement depth
 	for(vector<int>::iterator ii=move_list.begin();ii!=move_list.end();ii++)
 	{
-		
-		BoardState b_copy = b;
-		assert(b_copy.is_legal_move(*ii));
-		b_copy.play_move(*ii);
+		if(split_here(ii, move_list, depth, settings))
+		{
+			int move=read_siblings(b, h, target, depth, false, ii, move_list, settings, log);
+			if(log.stopped) return true;
+			region.insert_hash(false, target, depth, move!=-1, move);
+			return move!=-1;
+		}
+		assert(b.is_legal_move(*ii));
+		b.play_move(*ii);
 		
 		log.current_depth++;
-		bool result = can_capture(b_copy, target, depth, settings, log);
+		bool result = can_capture(b, h, target, depth, settings, log);
 		log.current_depth--;
+		b.undo_move();
 
+		if(log.stopped) return true;
 		if(result==false)
 		{
-			b.hash->insert_hash(b, false, target, depth, true);
+			region.insert_hash(false, target, depth, true, *ii);
 			return true;
 		}
 	}
 
 	// If we tried all escaping moves and none worked, return false
-	b.hash->insert_hash(b, false, target, depth, false);
+	region.insert_hash(false, target, depth, false);
 	return false;
 }
 
+// The hash policy is picked once here, so that the nodes of the search call each other directly
+bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	if(b.hash!=NULL) return can_capture(b, *b.hash, target, depth, settings, log);
+	NullHash no_table;
+	return can_capture(b, no_table, target, depth, settings, log);
+}
+
+bool can_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log)
+{
+	if(b.hash!=NULL) return can_escape(b, *b.hash, target, depth, settings, log);
+	NullHash no_table;
+	return can_escape(b, no_table, target, depth, settings, log);
+}
+
 void capture_moves(BoardState& b, int target, int depth, vector<int>& output, ReadingLog& log)
 {
 	// We create a list of possible capturing moves of various types:
@@ -473,12 +965,15 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 
 	// Liberties of target
 	vector<int> target_libs;
-	b.lump_adj_liberties(target, HV, target_libs);
+	b.lump_adj_liberties(b.board[target], HV, target_libs);
+	// What the defender would get by playing on each of them
+	MoveFeatures defence;
+	b.move_features(b.colour(target), b.lump_liberty_set[b.board[target]], defence);
 
 	//Check for easy escapes - if a particular escaping move gives you lots of libs then it's the only possible capturing move.
 	for(vector<int>::iterator ii = target_libs.begin();ii!=target_libs.end();ii++)
 	{
-		if(b.resulting_liberties(*ii, b.colour(target))>depth && depth>1)
+		if(defence.resulting_liberties[*ii]>depth && depth>1)
 		{
 			if(b.is_legal_move(*ii))
 			{
@@ -494,7 +989,7 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 
 	// Moves on the diagonal of target that share at least one liberty with target
 	vector<int> target_diagonals;
-	b.lump_adj_liberties(target, DIAG, target_diagonals);
+	b.lump_adj_liberties(b.board[target], DIAG, target_diagonals);
 	for(vector<int>::iterator ii=target_diagonals.begin();ii!=target_diagonals.end();)
 	{
 		// Erase those diagonals that are already HV liberties
@@ -517,21 +1012,21 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 	// Moves to defend surrounding groups in atari
 	vector<int> defend_atari;
 	// List of lumps surrounding target
-	vector<Lump*> adj_enemies;
-	b.lump_adj_lumps(target, HV, FRIEND, adj_enemies); //FRIEND here because capturer is to move	
+	vector<int> adj_enemies;
+	b.lump_adj_lumps(b.board[target], HV, FRIEND, adj_enemies); //FRIEND here because capturer is to move	
 	int friendly_in_atari=0;
 
-	for(vector<Lump*>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
+	for(vector<int>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
 	{
-		if((*ii)->liberties==1) // If a surrounding group is in atari...
+		if(b.lump_liberties[*ii]==1) // If a surrounding group is in atari...
 		{
-			friendly_in_atari+=(*ii)->size();
+			friendly_in_atari+=b.lump_size[*ii];
 			// ...list all groups surrounding *that* in atari, and try capturing them
-			vector<Lump*> adj_en_en;
+			vector<int> adj_en_en;
 			b.lump_adj_lumps(*ii, HV, ENEMY, adj_en_en);
-			for(vector<Lump*>::iterator jj=adj_en_en.begin();jj!=adj_en_en.end();jj++)
+			for(vector<int>::iterator jj=adj_en_en.begin();jj!=adj_en_en.end();jj++)
 			{
-				if((*jj)->liberties==1){b.lump_adj_liberties(*jj,HV,defend_atari);}
+				if(b.lump_liberties[*jj]==1){b.lump_adj_liberties(*jj,HV,defend_atari);}
 			}
 			// ...and if not caught in a ladder, also try just extending.
 			// NB We can't put ladderable check above, because if laddered, we sometimes want to capture anyway, e.g.
@@ -540,11 +1035,11 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 			// |.XOOOX
 			// |..X.X.
 			// Also, we want to extend a one-stone laddered lump into two if it might create snapback or damezumari.
-			if(!is_laddered(b, (*ii)->stones[0], log)||(b.liberties(target)<=3 &&(*ii)->size()==1)) b.lump_adj_liberties(*ii, HV, defend_atari);
+			if(!is_laddered(b, b.lump_stone[*ii], log)||(b.liberties(target)<=3 &&b.lump_size[*ii]==1)) b.lump_adj_liberties(*ii, HV, defend_atari);
 			// Check whether this surrounding stone is essential.
 			vector<int> new_libs; // Liberties that would be obtained by target if *ii dies.
 			new_libs.clear();
-			for(vector<Lump*>::iterator jj=adj_en_en.begin();jj!=adj_en_en.end();jj++)
+			for(vector<int>::iterator jj=adj_en_en.begin();jj!=adj_en_en.end();jj++)
 			{
 				b.lump_adj_liberties(*jj, HV, new_libs);
 			}
@@ -552,7 +1047,7 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 			new_libs.erase(unique(new_libs.begin(), new_libs.end()), new_libs.end());
 			if(new_libs.size()>depth+1)
 			{
-				log.addline("Must capture ");log.addpos((*ii)->stones[0]);
+				log.addline("Must capture ");log.addpos(b.lump_stone[*ii]);
 				for(vector<int>::iterator ii=defend_atari.begin();ii!=defend_atari.end();ii++) // Defend atari
 				{
 					if(find(possible_moves.begin(), possible_moves.end(), *ii)==possible_moves.end()) possible_moves.push_back(*ii);
@@ -577,6 +1072,7 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 	int lib1, lib2;
 	int lib1libs, lib2libs;
 	bool adjacent;
+	MoveFeatures attack;
 	// Output high-priority moves here (depending on number of liberties of target)
 	switch(b.liberties(target))
 	{
@@ -588,22 +1084,23 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 		sort(target_libs.begin(), target_libs.end());
 		lib1 = target_libs[0];
 		lib2 = target_libs[1];
-		if(b.is_legal_move(lib1)) lib1libs=b.resulting_liberties(lib1, b.to_move);
-		if(b.is_legal_move(lib2)) lib2libs=b.resulting_liberties(lib2, b.to_move);
+		b.move_features(b.to_move, b.lump_liberty_set[b.board[target]], attack);
+		lib1libs=attack.resulting_liberties[lib1];
+		lib2libs=attack.resulting_liberties[lib2];
 		if(lib2-lib1==1 || lib2-lib1==b.board_size) adjacent=true;
 		else adjacent =false;
 		
 		// If one liberty has only one adjacent liberty, play the other.
 		// Also if one liberty has two adjacent spaces, one of which is the other liberty.
 		// /*Only if at most one stone in atari*/ Removed "&& friendly_in_atari<=1" from first condition here and below. Seems unnecessary?
-		if(b.is_legal_move(lib2)){
+		if(attack.legal.test(lib2)){
 			if((lib2libs>1 && b.n_adj_liberties(lib1, HV)==1)
 			|| (adjacent && lib2libs>1 && b.n_adj_liberties(lib1, HV)==2))
 			{
 				if(find(possible_moves.begin(), possible_moves.end(), lib2)==possible_moves.end()) possible_moves.push_back(lib2);
 			}
 		}
-		if(b.is_legal_move(lib1)){
+		if(attack.legal.test(lib1)){
 			if((lib1libs>1 && b.n_adj_liberties(lib2, HV)==1)
 			|| (adjacent && lib1libs>1 && b.n_adj_liberties(lib2, HV)==2))
 			{
@@ -614,7 +1111,7 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 		// If diagonally adjacent libs and no friendly stones in atari, add net move
 		if(((lib2-lib1==b.board_size+1 || lib2-lib1==b.board_size-1)&&(target_diagonals.size()==1))&&friendly_in_atari==0) 
 		{
-			if((!b.is_atari(lib1, ENEMY))&&(!b.is_atari(lib2, ENEMY)))
+			if((!defence.atari.test(lib1))&&(!defence.atari.test(lib2)))
 			{
 			if(find(possible_moves.begin(), possible_moves.end(), lib1+b.board_size)==possible_moves.end()) possible_moves.push_back(lib1+b.board_size);
 			if(find(possible_moves.begin(), possible_moves.end(), lib2-b.board_size)==possible_moves.end()) possible_moves.push_back(lib2-b.board_size);
@@ -622,7 +1119,7 @@ void capture_moves(BoardState& b, int target, int depth, vector<int>& output, Re
 		}
 
 		// Finally, try the space with fewest liberties first
-		if(b.is_legal_move(lib2) && b.n_adj_liberties(lib2, HV)>b.n_adj_liberties(lib1, HV))
+		if(attack.legal.test(lib2) && b.n_adj_liberties(lib2, HV)>b.n_adj_liberties(lib1, HV))
 		{
 			if(find(possible_moves.begin(), possible_moves.end(), lib2)==possible_moves.end()) possible_moves.push_back(lib2);
 		}
@@ -660,24 +1157,38 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 
 	// Liberties of target
 	vector<int> target_libs;
-	b.lump_adj_liberties(target, HV, target_libs);
-	// Sort them by number of liberties they gain
+	b.lump_adj_liberties(b.board[target], HV, target_libs);
+	// Moves on the diagonal of target that share at least one liberty with target
+	vector<int> target_diagonals;
+	b.lump_adj_liberties(b.board[target], DIAG, target_diagonals);
+	// Lumps surrounding target
+	vector<int> adj_enemies;
+	b.lump_adj_lumps(b.board[target], HV, ENEMY, adj_enemies); //ENEMY here because escaper is to move
+	assert(b.to_move==b.colour(target));
+
+	// Every move generated below is a liberty or diagonal of target, or a liberty of a surrounding
+	// lump with at most two liberties. Work out the features of all of those at once.
+	BitSet region = b.lump_liberty_set[b.board[target]];
+	for(vector<int>::iterator ii=target_diagonals.begin();ii!=target_diagonals.end();ii++) region.set(*ii);
+	for(vector<int>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
+	{
+		if(b.lump_liberties[*ii]<=2) region|=b.lump_liberty_set[*ii];
+	}
+	MoveFeatures features;
+	b.move_features(b.to_move, region, features);
+
+	// Sort the liberties by number of liberties they gain
 	struct CompareLibs
 	{
-		BoardState* b_ptr;
-		int colour;
-		CompareLibs(BoardState* b_ptr, int colour){this->b_ptr=b_ptr; this->colour=colour;}
+		const MoveFeatures* f;
+		CompareLibs(const MoveFeatures* f){this->f=f;}
 		// Order largest first
 		bool operator()(int pos1, int pos2)
-		{ return b_ptr->resulting_liberties(pos1, colour)> b_ptr->resulting_liberties(pos2, colour);}		
+		{ return f->resulting_liberties[pos1] > f->resulting_liberties[pos2];}
 	};
 
-	sort(target_libs.begin(), target_libs.end(), CompareLibs(&b, b.colour(target)));
+	sort(target_libs.begin(), target_libs.end(), CompareLibs(&features));
 
-
-	// Moves on the diagonal of target that share at least one liberty with target
-	vector<int> target_diagonals;
-	b.lump_adj_liberties(target, DIAG, target_diagonals);
 	for(vector<int>::iterator ii=target_diagonals.begin();ii!=target_diagonals.end();)
 	{
 		// Remove it if it's already an HV liberty of target
@@ -698,23 +1209,21 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 	}
 
 	// Moves to capture surrounding groups in atari
-	vector<Lump*> adj_enemies;
-	b.lump_adj_lumps(target, HV, ENEMY, adj_enemies); //ENEMY here because escaper is to move
 	vector<int> capture_outside;
 	vector<int> attack_outside;
 	vector<int> atari_store;
-	for(vector<Lump*>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
+	for(vector<int>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
 	{
-		if((*ii)->liberties==1) // If a surrounding group is in atari...
+		if(b.lump_liberties[*ii]==1) // If a surrounding group is in atari...
 		{
 			// ...try capturing it
 			b.lump_adj_liberties(*ii, HV, capture_outside);
 		}
-		if(((*ii)->liberties==2) && (target_libs.size()>1)) // If a surrounding group has two liberties and we have at least two liberties ourselves...
+		if((b.lump_liberties[*ii]==2) && (target_libs.size()>1)) // If a surrounding group has two liberties and we have at least two liberties ourselves...
 		{
 			// ...generate moves to attack it.
 			// Put laddering moves in with capturing moves, to try first.
-			is_ladderable(b, **ii , &capture_outside, log);
+			is_ladderable(b, b.lump_stone[*ii], &capture_outside, log);
 			// Put other ataris into atari store. Any duplicates in this list (double ataris) will get pushed in a minute.
 			// The rest go in attack_outside, which has low priority and also goes in time_wasters
 			b.lump_adj_liberties(*ii, HV, atari_store);
@@ -724,7 +1233,7 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 	// Duplicates in atari_store are double ataris and should be tried early
 	for(vector<int>::iterator kk=atari_store.begin();kk!=atari_store.end();)
 	{
-		if(b.resulting_liberties(*kk, b.to_move)<=1) kk=atari_store.erase(kk);
+		if(features.resulting_liberties[*kk]<=1) kk=atari_store.erase(kk);
 		else kk++;
 	}
 	sort(atari_store.begin(), atari_store.end());
@@ -733,7 +1242,7 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 	{
 		// If not self-atari, then push the double atari to possible move list, and delete it.
 		if(find(possible_moves.begin(), possible_moves.end(), *kk)==possible_moves.end()
-			&& b.resulting_liberties(*kk, b.colour(target))>1) possible_moves.push_back(*kk);
+			&& features.resulting_liberties[*kk]>1) possible_moves.push_back(*kk);
 		atari_store.erase(kk, kk+1);
 		kk = adjacent_find(atari_store.begin(), atari_store.end());
 	}
@@ -742,12 +1251,12 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 	// We only want them if it reduces a surrounding group from three liberties to two
 	for(vector<int>::iterator kk = atari_store.begin();kk!=atari_store.end();kk++)
 	{
-		vector<Lump*> store;
+		vector<int> store;
 		b.adj_lumps(*kk, HV, ENEMY, store);
-		for(vector<Lump*>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
+		for(vector<int>::iterator ii=adj_enemies.begin();ii!=adj_enemies.end();ii++)
 		{
 			
-			if((*ii)->liberties == 3 && find(store.begin(), store.end(), *ii)!=store.end())
+			if(b.lump_liberties[*ii] == 3 && find(store.begin(), store.end(), *ii)!=store.end())
 			{
 				attack_outside.push_back(*kk);
 			}
@@ -791,6 +1300,6 @@ void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output
 	for(vector<int>::iterator ii=possible_moves.begin();ii!=possible_moves.end();ii++)
 	{
 		log.addpos(*ii);
-		if(b.is_legal_move(*ii)) output.push_back(*ii);
+		if(features.legal.test(*ii)) output.push_back(*ii);
 	}
 }
\ No newline at end of file
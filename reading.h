@@ -7,29 +7,77 @@
 #include <time.h>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <atomic>
 #include "board.h"
 #include "globals.h"
 #include "hashing.h"
 
+// Which search answers the capture and escape questions: the fixed-depth reader in reading.cpp (with
+// reading_depth and branch_limit), the df-pn solver in dfpn.cpp (which has no depth limit), or lambda
+// search in lambda.cpp (to reading_depth, with up to lambda_order)
+const int FIXED_DEPTH_SOLVER = 0;
+const int DFPN_SOLVER = 1;
+const int LAMBDA_SOLVER = 2;
+
 struct ReadingSettings
 {
 public:
 	int reading_depth;
 	int escape_libs;
 	int branch_limit;
-	HashObject* hash; // It is the responsibility of the engine to look after the hashing object
+	int node_budget; // Nodes each read may use, 0 for no limit (see read_status in reading.cpp)
+	int solver;
+	int threads; // Threads that share the moves of a read (see read_in_parallel in reading.cpp); 1 for none
+	int split_depth; // With threads, the least depth at which can_capture and can_escape read their moves in parallel
+	int split_moves; // And the least number of moves they must have left to read for that
+	int lambda_order; // Highest order of tree the lambda solver searches, at most MAX_LAMBDA_ORDER
+	ZobristHash* hash; // It is the responsibility of the engine to look after the hashing object
 
 	ReadingSettings(void)
 	{
 		reading_depth=5;
 		escape_libs=5;
 		branch_limit=6;
+		node_budget=0;
+		solver=FIXED_DEPTH_SOLVER;
+		threads=1;
+		split_depth=4;
+		split_moves=3;
+		lambda_order=3;
 	}
 	ReadingSettings(int r, int e, int b)
 	{
 		reading_depth=r;
 		escape_libs=e;
 		branch_limit=b;
+		node_budget=0;
+		solver=FIXED_DEPTH_SOLVER;
+		threads=1;
+		split_depth=4;
+		split_moves=3;
+		lambda_order=3;
+	}
+};
+
+// What the tasks of one parallel loop share: their nodes, counted against the read's node budget,
+// and a flag that stops them all once one has settled the answer. A loop started by a task of
+// another loop counts its nodes in the outermost loop, and stops when any loop around it does.
+struct SharedReading
+{
+	std::atomic<int> moves; // Only used in the outermost loop
+	std::atomic<bool> cancelled;
+	SharedReading* parent; // The loop of the task that started this one, or NULL
+	std::atomic<int>& total_moves(void)
+	{
+		SharedReading* s=this;
+		while(s->parent!=NULL) s=s->parent;
+		return s->moves;
+	}
+	bool any_cancelled(void) const
+	{
+		for(const SharedReading* s=this;s!=NULL;s=s->parent) if(s->cancelled.load(std::memory_order_relaxed)) return true;
+		return false;
 	}
 };
 
@@ -40,12 +88,53 @@ public:
 	int current_depth;
 	int total_moves;
 	bool logging;
+	int board_size; // For printing positions as coordinates
 	std::ofstream log;
 	//std::stringstream log;
-	ReadingLog(void)
+
+	// The budget of the read under way. Once it has run out, stopped is set and the search unwinds
+	// without storing anything. The deadline covers everything read with this log, so an engine can
+	// set one for a whole move.
+	int node_limit; // Stop when total_moves reaches this; 0 for no limit
+	bool has_deadline;
+	std::chrono::steady_clock::time_point deadline;
+	bool stopped;
+	int unproven; // df-pn reads that gave up without an answer (see dfpn.cpp)
+	SharedReading* shared; // For the log of one task of a parallel loop, NULL otherwise
+	void set_time_limit(int ms)
+	{
+		has_deadline=(ms>0);
+		deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(ms);
+	}
+	// Called once per node. The clock, and the other tasks of a parallel loop, are only looked at every 64 nodes.
+	bool out_of_budget(void)
+	{
+		if(!stopped && shared==NULL && node_limit!=0 && total_moves>=node_limit) stopped=true;
+		if(!stopped && (total_moves&63)==0)
+		{
+			if(shared!=NULL)
+			{
+				int moves=shared->total_moves().fetch_add(64, std::memory_order_relaxed)+64;
+				if((node_limit!=0 && moves>=node_limit) || shared->any_cancelled()) stopped=true;
+			}
+			if(has_deadline && std::chrono::steady_clock::now()>=deadline) stopped=true;
+		}
+		return stopped;
+	}
+
+	ReadingLog(int bsize)
 	{
 		log.open("logfile.txt");
-		current_depth=0; total_moves=0; logging=true;
+		current_depth=0; total_moves=0; logging=true; board_size=bsize;
+		node_limit=0; has_deadline=false; stopped=false; unproven=0; shared=NULL;
+	}
+	// The log of one task of a parallel loop in parent's read: it writes nothing, and keeps to the
+	// read's budget along with the other tasks
+	ReadingLog(const ReadingLog& parent, SharedReading* s)
+	{
+		current_depth=parent.current_depth; total_moves=0; logging=false; board_size=parent.board_size;
+		node_limit=parent.node_limit; has_deadline=parent.has_deadline; deadline=parent.deadline;
+		stopped=false; unproven=0; shared=s;
 	}
 	void addline(std::string in)
 	{
@@ -68,15 +157,15 @@ public:
 		log << j%10 << "|";
 		for(int i=0;i<b.board_size;i++)
 		{
-			if(b.board[(b.board_size*j)+i]==NULL)
+			if(b.board[(b.board_size*j)+i]==NO_LUMP)
 			{
 				log<<(b.ko_marker==(b.board_size*j)+i ? ":" : ".");
 			} else {
-				if(b.board[(b.board_size*j)+i]->colour==BLACK)
+				if(b.colour((b.board_size*j)+i)==BLACK)
 				{
-					log<<(b.board[(b.board_size*j)+i]->invincible ? "k" : "X");
+					log<<(b.is_invincible((b.board_size*j)+i) ? "k" : "X");
 				} else {
-					log<<(b.board[(b.board_size*j)+i]->invincible ? "c" : "O");
+					log<<(b.is_invincible((b.board_size*j)+i) ? "c" : "O");
 				}
 			}
 		}
@@ -88,7 +177,7 @@ public:
 	//log.flush();
 	}
 	void add(std::string in) {if(logging){log<<in;}}
-	void addpos(int in) {if(logging){log<<"("<<(in%9)<<" "<<(int)(in/9)<<")"; start_time = time(NULL);}}
+	void addpos(int in) {if(logging){log<<"("<<(in%board_size)<<" "<<(int)(in/board_size)<<")"; start_time = time(NULL);}}
 	void addint(int in) {if(logging){log<<in;}}
 	void pause(void){int i; std::cout<<"\nPaused..."; std::cin>>i; return;}
 
@@ -98,19 +187,36 @@ public:
 // get_status returns ALIVE, DEAD, UNSETTLED for target.
 // ALIVE = cannot be captured; UNSETTLED = can be captured, but capture can be prevented if target moves first; DEAD = no escape.
 // If get_defences is false, can only return ALIVE or DEAD. Outputs to capture_here and escape_here, unless they are NULL.
+// With a node budget in settings or a deadline in log, this and get_capturable read by iterative deepening (read_status).
 int get_status(BoardState& b, int target, bool get_defences, std::vector<int>* capture_here, std::vector<int>* escape_here, ReadingSettings& settings, ReadingLog& log);
 
+// What an iterative deepening read found: the answer of the deepest read that finished in budget
+struct ReadResult
+{
+	int status; // As get_status; for read_capture and read_escape, DEAD if the target can be captured and ALIVE if not
+	int depth; // Depth of that read (0 if none finished, and then status is ALIVE: nothing was found; also 0 from df-pn)
+	bool proven; // False if the budget ran out before the answer was settled
+};
+
+// Read at depth 1, 2, ... up to settings.reading_depth, until the answer is settled or the budget runs out.
+// A capture found (or an escape that fails) holds at any depth, so it settles the answer straight away;
+// anything else is settled by the read at reading_depth. With the df-pn solver there is just the one read.
+ReadResult read_status(BoardState& b, int target, bool get_defences, std::vector<int>* capture_here, std::vector<int>* escape_here, ReadingSettings& settings, ReadingLog& log);
+ReadResult read_capture(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log);
+ReadResult read_escape(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log);
+
 // Essentially colour-correcting versions of can_capture and can_escape
 bool get_capturable(BoardState& b, int target, int colour, ReadingSettings& settings, ReadingLog& log);
 bool get_escapable(BoardState& b, int target, ReadingSettings& settings, ReadingLog& log);
 
 //Returns true if target can be captured with a series of ataris
-bool is_ladderable(BoardState& b, Lump& target, std::vector<int>* output, ReadingLog& log);
 bool is_ladderable(BoardState& b, int pos, std::vector<int>* output, ReadingLog& log);
 bool is_laddered(BoardState& bd, int pos, ReadingLog& log);
 
 bool can_capture(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log);
 bool can_escape(BoardState& b, int target, int depth, ReadingSettings& settings, ReadingLog& log);
+// True if the position on b, with the same player to move, occurred since the move numbered start
+bool is_repetition(BoardState& b, size_t start);
 void capture_moves(BoardState& b, int target, int depth, std::vector<int>& output, ReadingLog& log);
 void escape_moves(BoardState& b, int target, int depth, std::vector<int>& output, ReadingLog& log);
 
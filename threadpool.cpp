@@ -0,0 +1,137 @@
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <assert.h>
+#include "threadpool.h"
+
+using namespace std;
+
+// The pool whose worker this thread is, if any, and that worker's queue
+static thread_local ThreadPool* current_pool=NULL;
+static thread_local int current_queue=0;
+
+ThreadPool::ThreadPool(int n_threads): queues(n_threads), stopping(false)
+{
+	assert(n_threads>=1);
+	for(int i=1;i<n_threads;i++) workers.push_back(thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> l(lock);
+		stopping=true;
+	}
+	changed.notify_all();
+	for(size_t i=0;i<workers.size();i++) workers[i].join();
+}
+
+int ThreadPool::own_queue(void)
+{
+	return (current_pool==this ? current_queue : 0);
+}
+
+thread_local ThreadPool::Job* ThreadPool::current_job=NULL;
+
+// Whether job was started, at some remove, from a task of ancestor
+bool ThreadPool::descends_from(const Job* job, const Job* ancestor)
+{
+	for(;job!=NULL;job=job->parent)
+	{
+		if(job==ancestor) return true;
+	}
+	return false;
+}
+
+// A job with a task to steal (lock held): the newest in queue, or else the oldest in the next queue along
+// that has one. Given within, only jobs descended from it count.
+ThreadPool::Job* ThreadPool::find_work(int queue, Job* within)
+{
+	for(deque<Job*>::reverse_iterator ii=queues[queue].rbegin();ii!=queues[queue].rend();ii++)
+	{
+		if(within==NULL || descends_from((*ii)->parent, within)) return *ii;
+	}
+	for(size_t i=1;i<queues.size();i++)
+	{
+		deque<Job*>& victim=queues[(queue+i)%queues.size()];
+		for(deque<Job*>::iterator ii=victim.begin();ii!=victim.end();ii++)
+		{
+			if(within==NULL || descends_from((*ii)->parent, within)) return *ii;
+		}
+	}
+	return NULL;
+}
+
+// Begin the next task of job and run it, with l unlocked meanwhile. The job stops waiting once its
+// last task has begun.
+void ThreadPool::run_one(unique_lock<mutex>& l, Job& job)
+{
+	int task=job.next++;
+	if(job.next==job.n_tasks)
+	{
+		deque<Job*>& queue=queues[job.queue];
+		deque<Job*>::iterator ii=find(queue.begin(), queue.end(), &job);
+		if(ii!=queue.end()) queue.erase(ii);
+	}
+	Job* outer=current_job;
+	current_job=&job;
+	l.unlock();
+	job.batch->run_task(task);
+	l.lock();
+	current_job=outer;
+	if(++job.done==job.n_tasks) changed.notify_all();
+}
+
+void ThreadPool::run(TaskBatch& batch, int n_tasks)
+{
+	if(n_tasks==0) return;
+	Job job;
+	job.batch=&batch;
+	job.n_tasks=n_tasks;
+	job.next=0;
+	job.done=0;
+	job.queue=own_queue();
+	job.parent=current_job;
+	unique_lock<mutex> l(lock);
+	if(n_tasks>1 && !workers.empty())
+	{
+		queues[job.queue].push_back(&job);
+		changed.notify_all();
+	}
+	while(job.next<n_tasks) run_one(l, job);
+	// The job is on this thread's stack, so it must not go until the others are finished with it
+	while(job.done<n_tasks)
+	{
+		Job* other=find_work(job.queue, &job);
+		if(other!=NULL) run_one(l, *other);
+		else changed.wait(l);
+	}
+}
+
+void ThreadPool::work(int queue)
+{
+	current_pool=this;
+	current_queue=queue;
+	unique_lock<mutex> l(lock);
+	while(true)
+	{
+		Job* job=NULL;
+		while(!stopping && (job=find_work(queue, NULL))==NULL) changed.wait(l);
+		if(stopping) return;
+		run_one(l, *job);
+	}
+}
+
+ThreadPool& reading_pool(int n_threads)
+{
+	static mutex pools_lock;
+	static map<int, ThreadPool*> pools; // Never freed: at exit another thread could still be reading with one
+	lock_guard<mutex> l(pools_lock);
+	ThreadPool*& pool=pools[n_threads];
+	if(pool==NULL) pool=new ThreadPool(n_threads);
+	return *pool;
+}
@@ -0,0 +1,66 @@
+#ifndef THREADPOOL_H_300712
+#define THREADPOOL_H_300712
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Tasks numbered from 0, for ThreadPool::run. Each task is run once, on some thread of the pool.
+class TaskBatch
+{
+public:
+	virtual void run_task(int task)=0;
+	virtual ~TaskBatch(){}
+};
+
+// A fixed set of worker threads, started once and kept, so that splitting a read between threads
+// does not pay for starting them. Any thread may call run, including a task running in the pool.
+// Scheduling is work stealing. Each thread keeps the batches it has started in its own queue; threads
+// from outside the pool share one. The caller of run works through its own batch, while idle threads
+// steal the next task of the oldest batch in another queue, which (as batches nest) has the biggest
+// tasks. A caller left waiting for tasks that others have begun runs other tasks meanwhile rather than
+// sleeping, but only tasks of batches started from its own batch's tasks (and so on down). Those are
+// parts of its own work, so it never gets stuck under an unrelated task, and as each is a smaller
+// subtree the tasks nested on one thread's stack are bounded by the depth of the read. The queues are
+// kept under a single lock: a task is a whole subtree of a read, so taking one is cheap next to running it.
+class ThreadPool
+{
+public:
+	ThreadPool(int n_threads); // n_threads-1 workers, as the caller of run is a thread too
+	~ThreadPool();
+	// Run tasks 0 to n_tasks-1 of batch, on the calling thread and any idle workers, returning when all are done
+	void run(TaskBatch& batch, int n_tasks);
+	int size(void){return (int)workers.size()+1;}
+private:
+	// A batch being run. Its counts are only touched with lock held.
+	struct Job
+	{
+		TaskBatch* batch;
+		int n_tasks;
+		int next; // First task not yet begun
+		int done;
+		int queue; // Where it waits while it has tasks not yet begun
+		Job* parent; // The job whose task started this one, or NULL
+	};
+	static thread_local Job* current_job; // The job whose task this thread is running, or NULL
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable changed; // A batch has been queued or finished, or the pool is stopping
+	std::vector<std::deque<Job*> > queues; // Jobs with tasks not yet begun, oldest first: [0] outside the pool, [i] worker i
+	bool stopping;
+	int own_queue(void);
+	static bool descends_from(const Job* job, const Job* ancestor);
+	Job* find_work(int queue, Job* within);
+	void run_one(std::unique_lock<std::mutex>& l, Job& job);
+	void work(int queue);
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+// The pool of n_threads threads that reading uses (see settings.threads in reading.h), made on first use.
+// Pools are kept for the whole run.
+ThreadPool& reading_pool(int n_threads);
+
+#endif
@@ -4,11 +4,15 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
 #include "globals.h"
 #include <time.h>
 #include "board.h"
 #include "hashing.h"
 #include "reading.h"
+#include "bitboard.h"
 #include "lifedeath.h"
 #include "TLGETC.h" 
 #include <SFML/Graphics/RenderWindow.hpp>
@@ -92,9 +96,9 @@ void draw_board(sf::RenderWindow& window, WindowData& wd, BoardState& b, Engine&
 	// Draw on stones and ko marker
 	for(int i=0;i<b.board_size*b.board_size;i++)
 	{
-		if(b.board[i]!=NULL)
+		if(b.board[i]!=NO_LUMP)
 		{
-			wd.draw_circle(i%wd.board_size,(int)i/wd.board_size,0,0, wd.half_width - 1, (b.board[i]->colour==BLACK?sf::Color::Black : sf::Color::White), window);
+			wd.draw_circle(i%wd.board_size,(int)i/wd.board_size,0,0, wd.half_width - 1, (b.colour(i)==BLACK?sf::Color::Black : sf::Color::White), window);
 		}
 		if(i==b.ko_marker)
 		{
@@ -109,18 +113,20 @@ void draw_board(sf::RenderWindow& window, WindowData& wd, BoardState& b, Engine&
 	{
 		sf::Color team_colour;
 		map<int, sf::Color>::iterator tc;
-		tc = wd.team_colours.find((*ii)->lumps[0]->stones[0]);
+		tc = wd.team_colours.find(b.lump_stone[(*ii)->lumps[0]]);
 		if(tc==wd.team_colours.end())
 		{
 			team_colour = sf::Color::Color(rand()%255, rand()%255, rand()%255);
-			wd.team_colours[(*ii)->lumps[0]->stones[0]] = team_colour;
+			wd.team_colours[b.lump_stone[(*ii)->lumps[0]]] = team_colour;
 		} else {
-			team_colour=wd.team_colours[(*ii)->lumps[0]->stones[0]];
+			team_colour=wd.team_colours[b.lump_stone[(*ii)->lumps[0]]];
 		}		 
 
-		for(vector<Lump*>::iterator jj = (*ii)->lumps.begin();jj!=(*ii)->lumps.end();jj++)
+		for(vector<int>::iterator jj = (*ii)->lumps.begin();jj!=(*ii)->lumps.end();jj++)
 		{
-		for(vector<int>::iterator kk = (*jj)->stones.begin();kk!=(*jj)->stones.end();kk++)
+		vector<int> stones;
+		b.lump_stones(*jj, stones);
+		for(vector<int>::iterator kk = stones.begin();kk!=stones.end();kk++)
 		{
 			wd.draw_circle((*kk)%wd.board_size,(int)(*kk)/wd.board_size,0,0, (int)wd.half_width/4, team_colour, window);
 			if(find(p->interesting_lumps.begin(), p->interesting_lumps.end(), *jj)!=p->interesting_lumps.end())
@@ -135,6 +141,22 @@ void draw_board(sf::RenderWindow& window, WindowData& wd, BoardState& b, Engine&
 
 }
 
+// Runs get_status on lumps[first], lumps[first+step], ... in its own copy of the board (which shares
+// the board's hash table), for the bench command
+void read_lumps(BoardState* board, vector<int>* lumps, int first, int step, int* nodes)
+{
+	BoardState b_copy = *board;
+	for(size_t i=first;i<lumps->size();i+=step)
+	{
+		ReadingLog log(b_copy.board_size);
+		log.logging=false;
+		ReadingSettings settings;
+		settings.hash=b_copy.hash;
+		get_status(b_copy, b_copy.lump_stone[(*lumps)[i]], true, NULL, NULL, settings, log);
+		*nodes+=log.total_moves;
+	}
+}
+
 void parse_command(string input, BoardState& board, Engine& engine)
 {
 	stringstream ss(input);
@@ -161,30 +183,77 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		int x, y;
 		ss>>x;
 		ss>>y;
-		if(board.board[x+board.board_size*y]==NULL)
+		if(board.board[x+board.board_size*y]==NO_LUMP)
 		{
 			cout<<"\nEmpty point.";
 		} else {
-			cout<<board.board[(x+board.board_size*y)]->display();
+			cout<<board.display_lump(board.board[(x+board.board_size*y)]);
 			cout<<"\nEngine data:\n";
 			Engine* p_engine = &engine;
 			TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
-			cout<<p_TLGETC->lump_data[p_TLGETC->b.board[x+board.board_size*y]].display(); // This line is revolting
+			cout<<p_TLGETC->lump_data[p_TLGETC->b.board[x+board.board_size*y]].display(p_TLGETC->b); // This line is revolting
 		}
 	} else if(command=="hash"||command=="i")
 	{
 		Engine* p_engine = &engine;
 		TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
-		cout<<"\nThe hash table currently has "<<p_TLGETC->hash.hash_table.size()<<" entries.\n";
-		cout<<"It has served "<<p_TLGETC->hash.queries<<" queries, of which "<<p_TLGETC->hash.positive_queries<<" were successful.\n";
-		cout<<(((_int64)1)<<(33+9));
+		HashStats stats = p_TLGETC->hash.stats();
+		cout<<"\nThe hash table currently has "<<stats.n_entries<<" entries (room for "<<p_TLGETC->hash.capacity()<<")";
+		cout<<(p_TLGETC->hash.is_file_backed() ? ", kept in a file.\n" : ".\n");
+		cout<<"It has served "<<stats.queries<<" queries, of which "<<stats.positive_queries<<" were successful";
+		cout<<" ("<<stats.region_queries<<" region-local, of which "<<stats.region_hits<<" were successful).\n";
+		cout<<"Queries by depth (queries/hits/found too shallow):\n";
+		for(int d=0;d<STATS_DEPTHS;d++)
+		{
+			if(stats.depth_queries[0][d]==0 && stats.depth_queries[1][d]==0) continue;
+			cout<<"  depth "<<d<<(d==STATS_DEPTHS-1 ? "+" : "");
+			cout<<"  capture "<<stats.depth_queries[1][d]<<"/"<<stats.depth_hits[1][d]<<"/"<<stats.shallow_hits[1][d];
+			cout<<"  escape "<<stats.depth_queries[0][d]<<"/"<<stats.depth_hits[0][d]<<"/"<<stats.shallow_hits[0][d]<<"\n";
+		}
+		cout<<stats.stores<<" results stored: "<<stats.updates<<" to entries already there, "<<stats.overwrites<<" overwriting other entries.\n";
+		cout<<"Proof number queries (df-pn): "<<stats.proof_queries<<", of which "<<stats.proof_hits<<" were successful.\n";
+		cout<<"Lambda search queries: "<<stats.lambda_queries<<", of which "<<stats.lambda_hits<<" were successful.\n";
+		cout<<stats.collisions<<" key collisions caught.\n";
+		cout<<"Table is "<<p_TLGETC->hash.table_bytes()<<" bytes, of which "<<(size_t)stats.n_entries*sizeof(HashEntry)<<" in use.\n";
+		vector<int> occupancy;
+		p_TLGETC->hash.count_occupancy(occupancy);
+		cout<<"Buckets by entries held:";
+		for(int n=0;n<=BUCKET_SLOTS;n++) cout<<" "<<n<<": "<<occupancy[n]<<(n<BUCKET_SLOTS ? "," : "\n");
+		// Entries by how many moves ago they were last used, in bands of 1, 1, 2, 4, ... moves
+		vector<int> ages;
+		p_TLGETC->hash.count_generations(ages);
+		cout<<"Entries by age in moves:";
+		for(int low=0, high=0;low<N_GENERATIONS;low=high+1, high=2*high+1)
+		{
+			int n=0;
+			for(int age=low;age<=high;age++) n+=ages[age];
+			cout<<" "<<low;
+			if(high>low) cout<<"-"<<high;
+			cout<<": "<<n<<(high<N_GENERATIONS-1 ? "," : "\n");
+		}
+	} else if(command=="hashdump")
+	{
+		// The same statistics, one "name value" per line, to a file if one is named
+		Engine* p_engine = &engine;
+		TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
+		string filename;
+		ss>>filename;
+		if(filename.empty())
+		{
+			cout<<"\n";
+			p_TLGETC->hash.write_stats(cout);
+		} else {
+			ofstream out(filename.c_str());
+			p_TLGETC->hash.write_stats(out);
+			cout<<(out ? "\nWritten to " : "\nCould not write ")<<filename;
+		}
 	} else if (command=="lumps" || command=="l")
 	{
-		vector<Lump*> list_of_lumps;
+		vector<int> list_of_lumps;
 		board.all_lumps(list_of_lumps);
-		for(vector<Lump*>::iterator ii=list_of_lumps.begin();ii!=list_of_lumps.end();ii++)
+		for(vector<int>::iterator ii=list_of_lumps.begin();ii!=list_of_lumps.end();ii++)
 		{
-			cout<<"\n"<<(*ii)->display();
+			cout<<"\n"<<board.display_lump(*ii);
 		}
 	} else if (command=="teams" || command=="t")
 	{
@@ -194,9 +263,9 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		for(vector<Team*>::iterator ii=p_TLGETC->teams.begin();ii!=p_TLGETC->teams.end();ii++)
 		{
 			cout<<"Team with lumps ";
-			for(vector<Lump*>::iterator jj = (*ii)->lumps.begin(); jj!=(*ii)->lumps.end();jj++)
+			for(vector<int>::iterator jj = (*ii)->lumps.begin(); jj!=(*ii)->lumps.end();jj++)
 			{
-				cout<<"("<<(*jj)->stones[0] % board.board_size<<","<<(int)(*jj)->stones[0] / board.board_size<<") ";
+				cout<<"("<<board.lump_stone[*jj] % board.board_size<<","<<(int)board.lump_stone[*jj] / board.board_size<<") ";
 			}
 			cout<<"\n";
 		}
@@ -205,11 +274,11 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		int x, y;
 		ss>>x;
 		ss>>y;
-		if(board.board[x+board.board_size*y]==NULL)
+		if(board.board[x+board.board_size*y]==NO_LUMP)
 		{
 			cout<<"\nEmpty point.";
 		} else {
-			ReadingLog log;
+			ReadingLog log(board.board_size);
 			int pos = (x+board.board_size*y);
 			vector<int> results;
 			bool wins = is_ladderable(board, pos, &results, log);
@@ -229,16 +298,34 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		int x, y;
 		ss>>x;
 		ss>>y;
-		if(board.board[x+board.board_size*y]==NULL)
+		if(board.board[x+board.board_size*y]==NO_LUMP)
 		{
 			cout<<"\nEmpty point.";
 		} else {
-			ReadingLog log;
+			ReadingLog log(board.board_size);
 			int pos = (x+board.board_size*y);
 			vector<int> capture_here;
 			vector<int> escape_here;
+			// Within the engine's budget, if it has one (see the budget command)
+			Engine* p_engine = &engine;
+			TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
 			ReadingSettings settings;
-			int result = get_status(board, pos, true, &capture_here, &escape_here, settings, log);
+			settings.node_budget = p_TLGETC->read_node_budget;
+			settings.solver = p_TLGETC->read_solver;
+			settings.lambda_order = p_TLGETC->lambda_order;
+			settings.threads = p_TLGETC->read_threads;
+			log.set_time_limit(p_TLGETC->move_time_ms);
+			chrono::steady_clock::time_point start=chrono::steady_clock::now();
+			ReadResult read;
+			if(settings.node_budget!=0 || log.has_deadline || settings.solver==DFPN_SOLVER)
+			{
+				read = read_status(board, pos, true, &capture_here, &escape_here, settings, log);
+			} else {
+				read.status = get_status(board, pos, true, &capture_here, &escape_here, settings, log);
+				read.depth = settings.reading_depth;
+				read.proven = true;
+			}
+			int result = read.status;
 
 			if(result==ALIVE)
 			{
@@ -260,9 +347,286 @@ void parse_command(string input, BoardState& board, Engine& engine)
 					cout<<"\nNo escaping moves found.";
 				}
 			}
+			if(settings.solver==DFPN_SOLVER) cout<<"\nRead with df-pn"<<(read.proven ? "." : ", which ran out of nodes or time.");
+			else cout<<"\nRead to depth "<<read.depth<<(read.proven ? "." : ", when the budget ran out.");
 			cout<<"\nTotal moves read: "<<log.total_moves;
-			cout<<"\nTime taken: " << difftime(time(NULL),log.start_time);
-			
+			cout<<"\nTime taken: "<<chrono::duration<double>(chrono::steady_clock::now()-start).count()<<" seconds";
+
+		}
+	} else if (command=="budget")
+	{
+		// Limits on the engine's reading: nodes for each read and milliseconds for each move (0 for no limit).
+		// The capture command reads within the same limits.
+		Engine* p_engine = &engine;
+		TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
+		int nodes, ms;
+		if(ss>>nodes)
+		{
+			p_TLGETC->read_node_budget=nodes;
+			if(ss>>ms) p_TLGETC->move_time_ms=ms;
+		}
+		cout<<"\nReading budget: "<<p_TLGETC->read_node_budget<<" nodes per read, "<<p_TLGETC->move_time_ms<<" ms per move (0 for no limit).";
+	} else if (command=="threads")
+	{
+		// Threads for each of the engine's reads to be shared between (1 for none).
+		// The capture command reads with the same number.
+		Engine* p_engine = &engine;
+		TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
+		int n;
+		if(ss>>n) p_TLGETC->read_threads=max(1, n);
+		cout<<"\nReading with "<<p_TLGETC->read_threads<<" thread"<<(p_TLGETC->read_threads==1 ? "." : "s.");
+	} else if (command=="solver")
+	{
+		// Which search the engine's reading uses: depth (the fixed-depth reader), dfpn or lambda [order].
+		// The capture command reads with the same one.
+		Engine* p_engine = &engine;
+		TLGETC* p_TLGETC = static_cast<TLGETC*>(p_engine);
+		string name;
+		if(ss>>name)
+		{
+			if(name=="depth") p_TLGETC->read_solver=FIXED_DEPTH_SOLVER;
+			else if(name=="dfpn") p_TLGETC->read_solver=DFPN_SOLVER;
+			else if(name=="lambda")
+			{
+				p_TLGETC->read_solver=LAMBDA_SOLVER;
+				int order;
+				if(ss>>order) p_TLGETC->lambda_order=max(1, min(order, MAX_LAMBDA_ORDER));
+			}
+			else cout<<"\nUnknown solver "<<name<<" (depth, dfpn or lambda).";
+		}
+		if(p_TLGETC->read_solver==LAMBDA_SOLVER) cout<<"\nReading with lambda search, up to order "<<p_TLGETC->lambda_order<<".";
+		else cout<<"\nReading with "<<(p_TLGETC->read_solver==DFPN_SOLVER ? "df-pn." : "the fixed-depth reader.");
+	} else if (command=="bitcheck")
+	{
+		// Checks the bitboard backend against BoardState: plays n_moves random legal moves from the position on
+		// both, and after each move compares the stones, liberties and legality at every point, and the
+		// liberties a move at each legal point would leave.
+		int n_moves=200;
+		ss>>n_moves;
+		BoardState b_copy = board;
+		BitBoard bb(b_copy);
+		int n_points=b_copy.board_size*b_copy.board_size;
+		int mismatches=0;
+		for(int m=0;m<n_moves;m++)
+		{
+			vector<int> legal;
+			for(int pos=0;pos<n_points;pos++) if(b_copy.is_legal_move(pos)) legal.push_back(pos);
+			int move=(legal.empty() ? -1 : legal[rand()%legal.size()]);
+			b_copy.play_move(move);
+			bb.play_move(move);
+			for(int pos=0;pos<n_points;pos++)
+			{
+				bool same=(bb.colour(pos)==b_copy.colour(pos) && bb.is_legal_move(pos)==b_copy.is_legal_move(pos));
+				if(same && b_copy.colour(pos)!=-1) same=(bb.liberties(pos)==b_copy.liberties(pos));
+				if(same && b_copy.is_legal_move(pos)) same=(bb.resulting_liberties(pos, b_copy.to_move)==b_copy.resulting_liberties(pos, b_copy.to_move));
+				if(!same && ++mismatches<=10) cout<<"\nAfter move "<<m+1<<" the backends differ at ("<<pos%b_copy.board_size<<","<<pos/b_copy.board_size<<")";
+			}
+		}
+		cout<<"\n"<<n_moves<<" moves played, "<<mismatches<<" mismatches";
+		cout<<"\nBitboard position size: "<<sizeof(BitBoard)<<" bytes";
+	} else if (command=="bench")
+	{
+		// Tactical reading benchmark: get_status on every lump in the position, starting each repeat from an empty hash table.
+		// With more than one thread the lumps are shared out between threads, which all use the same table.
+		int repeats=1;
+		int n_threads=1;
+		ss>>repeats>>n_threads;
+		if(n_threads<1) n_threads=1;
+		int nodes=0;
+		int queries=0, positive_queries=0;
+		chrono::steady_clock::time_point start=chrono::steady_clock::now();
+		for(int r=0;r<repeats;r++)
+		{
+			ZobristHash bench_hash(board.board_size);
+			BoardState b_copy = board;
+			b_copy.hash = &bench_hash;
+			vector<int> list_of_lumps;
+			b_copy.all_lumps(list_of_lumps);
+			vector<int> thread_nodes(n_threads, 0);
+			vector<thread> threads;
+			for(int t=0;t<n_threads;t++)
+			{
+				threads.push_back(thread(read_lumps, &b_copy, &list_of_lumps, t, n_threads, &thread_nodes[t]));
+			}
+			for(int t=0;t<n_threads;t++)
+			{
+				threads[t].join();
+				nodes+=thread_nodes[t];
+			}
+			HashStats stats = bench_hash.stats();
+			queries+=stats.queries;
+			positive_queries+=stats.positive_queries;
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+		cout<<"\n"<<nodes<<" nodes in "<<seconds<<" seconds";
+		if(seconds>0) cout<<" ("<<(int)(nodes/seconds)<<" nodes per second)";
+		cout<<"\n"<<queries<<" hash queries, "<<positive_queries<<" successful";
+	} else if (command=="splitbench")
+	{
+		// Parallel reading benchmark: get_status on every lump in the position, read to depth, with 1 to
+		// max_threads threads sharing each read, and an empty hash table for each thread count. Reports the
+		// speedup over 1 thread, and the lumps whose status differs from 1 thread's (see read_in_parallel).
+		int max_threads=4;
+		int depth=ReadingSettings().reading_depth;
+		ss>>max_threads>>depth;
+		vector<int> list_of_lumps;
+		board.all_lumps(list_of_lumps);
+		vector<int> first_statuses;
+		double first_seconds=0;
+		for(int n_threads=1;n_threads<=max_threads;n_threads++)
+		{
+			ZobristHash bench_hash(board.board_size);
+			BoardState b_copy = board;
+			b_copy.hash = &bench_hash;
+			ReadingSettings settings;
+			settings.hash = &bench_hash;
+			settings.reading_depth = depth;
+			settings.threads = n_threads;
+			int nodes=0;
+			vector<int> statuses;
+			chrono::steady_clock::time_point start=chrono::steady_clock::now();
+			for(size_t i=0;i<list_of_lumps.size();i++)
+			{
+				ReadingLog log(b_copy.board_size);
+				log.logging=false;
+				statuses.push_back(get_status(b_copy, b_copy.lump_stone[list_of_lumps[i]], true, NULL, NULL, settings, log));
+				nodes+=log.total_moves;
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+			if(n_threads==1)
+			{
+				first_statuses=statuses;
+				first_seconds=seconds;
+			}
+			int differences=0;
+			for(size_t i=0;i<statuses.size();i++) if(statuses[i]!=first_statuses[i]) differences++;
+			cout<<"\n"<<n_threads<<" thread"<<(n_threads==1 ? ": " : "s: ")<<nodes<<" nodes in "<<seconds<<" seconds";
+			if(seconds>0) cout<<", speedup "<<first_seconds/seconds;
+			if(differences>0) cout<<", "<<differences<<" statuses differ";
+		}
+	} else if (command=="hashbench")
+	{
+		// Cost of the hash table per node of reading: get_status on every lump in the position with no
+		// table (NullHash, the baseline) and then with an empty Zobrist table, repeats times each.
+		// The table finds transpositions, so it reads fewer nodes; the time per node is what to compare.
+		int repeats=1;
+		ss>>repeats;
+		ZobristHash bench_hash(board.board_size);
+		for(int with_table=0;with_table<2;with_table++)
+		{
+			int nodes=0;
+			double seconds=0;
+			for(int r=0;r<repeats;r++)
+			{
+				bench_hash.clear();
+				BoardState b_copy = board;
+				b_copy.hash = (with_table ? &bench_hash : NULL);
+				vector<int> list_of_lumps;
+				b_copy.all_lumps(list_of_lumps);
+				chrono::steady_clock::time_point start=chrono::steady_clock::now();
+				for(vector<int>::iterator ii=list_of_lumps.begin();ii!=list_of_lumps.end();ii++)
+				{
+					ReadingLog log(board.board_size);
+					log.logging=false;
+					ReadingSettings settings;
+					get_status(b_copy, b_copy.lump_stone[*ii], true, NULL, NULL, settings, log);
+					nodes+=log.total_moves;
+				}
+				seconds+=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+			}
+			cout<<"\n"<<(with_table ? "Zobrist table: " : "No table: ")<<nodes<<" nodes in "<<seconds<<" seconds";
+			if(nodes>0) cout<<" ("<<(int)(1e9*seconds/nodes)<<" ns per node)";
+		}
+	} else if (command=="mergebench")
+	{
+		// Lump merging benchmark on an empty 19x19 board: Black fills every other row (White passing),
+		// then joins the rows up one at a time down the left edge, so each of those moves merges two
+		// long lumps. Everything is undone and played again for each repeat.
+		int repeats=1000;
+		ss>>repeats;
+		const int bs=19;
+		ZobristHash bench_hash(bs);
+		BoardState b(bs);
+		b.hash = &bench_hash;
+		vector<int> sequence;
+		for(int y=0;y<bs;y+=2)
+		{
+			for(int x=0;x<bs-1;x++) sequence.push_back(x+bs*y);
+		}
+		for(int y=1;y<bs;y+=2) sequence.push_back(bs*y);
+		int moves=0;
+		clock_t start=clock();
+		for(int r=0;r<repeats;r++)
+		{
+			UndoGuard guard(b);
+			for(vector<int>::iterator ii=sequence.begin();ii!=sequence.end();ii++)
+			{
+				b.play_move(*ii);
+				b.play_move(-1);
+				moves+=2;
+			}
+		}
+		double seconds = (double)(clock()-start)/CLOCKS_PER_SEC;
+		cout<<"\n"<<moves<<" moves played and undone in "<<seconds<<" seconds";
+		if(seconds>0) cout<<" ("<<(int)(moves/seconds)<<" moves per second)";
+	} else if (command=="sizebench")
+	{
+		// Scaling benchmark: for each board size, the engine plays the same kind of random game (the same
+		// number of moves per point, from a fixed seed) and reports the average cost of make_move, then
+		// the cost of get_status on every lump of the final position with an empty hash table.
+		int moves_per_point=2;
+		ss>>moves_per_point;
+		const int sizes[3]={9, 13, 19};
+		for(int i=0;i<3;i++)
+		{
+			int bs=sizes[i];
+			TLGETC bench_engine(bs);
+			unsigned int seed=12345;
+			// make_move reports its progress on cout, which would swamp the results
+			stringstream quiet;
+			streambuf* old_cout=cout.rdbuf(quiet.rdbuf());
+			int moves=0;
+			clock_t start=clock();
+			for(int m=0;m<moves_per_point*bs*bs/4;m++)
+			{
+				// Random legal move that doesn't fill one of the mover's own eyes; pass if none turns up
+				int pos=-1;
+				for(int tries=0;tries<100;tries++)
+				{
+					seed=seed*1103515245+12345;
+					int p=(seed>>8)%(bs*bs);
+					if(bench_engine.b.is_legal_move(p) && bench_engine.b.n_adj_liberties(p, HV)+bench_engine.b.is_adj_to(p, HV, ENEMY)>0)
+					{
+						pos=p;
+						break;
+					}
+				}
+				bench_engine.make_move(pos);
+				moves++;
+			}
+			double move_seconds=(double)(clock()-start)/CLOCKS_PER_SEC;
+			cout.rdbuf(old_cout);
+
+			ZobristHash bench_hash(bs);
+			BoardState b_copy = bench_engine.b;
+			b_copy.hash = &bench_hash;
+			vector<int> list_of_lumps;
+			b_copy.all_lumps(list_of_lumps);
+			int nodes=0;
+			start=clock();
+			for(vector<int>::iterator ii=list_of_lumps.begin();ii!=list_of_lumps.end();ii++)
+			{
+				ReadingLog log(bs);
+				log.logging=false;
+				ReadingSettings settings;
+				get_status(b_copy, b_copy.lump_stone[*ii], true, NULL, NULL, settings, log);
+				nodes+=log.total_moves;
+			}
+			double status_seconds=(double)(clock()-start)/CLOCKS_PER_SEC;
+
+			cout<<"\n"<<bs<<"x"<<bs<<": "<<moves<<" moves, "<<(1000*move_seconds/moves)<<" ms per make_move; ";
+			cout<<list_of_lumps.size()<<" lumps, "<<nodes<<" nodes, ";
+			cout<<(list_of_lumps.empty() ? 0 : 1000*status_seconds/list_of_lumps.size())<<" ms per get_status";
 		}
 	} else if(command=="pass" || command=="p") {
 		engine.make_move(-1);
@@ -272,7 +636,7 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		vector<int> targets;
 		targets.push_back(target);
 		vector<int> extra_border;
-		ReadingLog log;
+		ReadingLog log(board.board_size);
 		log.addline("starting...");
 		get_status_in_box(board,targets, l, r, t, b, extra_border, log); 
 	} else if(command=="ipa")
@@ -281,7 +645,7 @@ void parse_command(string input, BoardState& board, Engine& engine)
 		ss>>x;
 		ss>>y;
 		vector<int> empty_vector;
-		ReadingLog log;
+		ReadingLog log(board.board_size);
 		if(is_pass_alive(board, x+board.board_size*y, empty_vector, log)) cout<<"\nPass-alive.";
 		else cout<<"\nNot pass-alive.";
 	} else {
@@ -294,7 +658,20 @@ int main(int argc, char* argv[])
 {
 	cout << "Testing The Little Go Engine That Could v0.1\n";
 
-	TLGETC engine(9);
+	// Board size can be given on the command line (9 by default)
+	int board_size=9;
+	if(argc>1) board_size=atoi(argv[1]);
+	if(board_size<2 || board_size>MAX_BOARD_SIZE)
+	{
+		cout << "Board size must be between 2 and "<<MAX_BOARD_SIZE<<"\n";
+		return 1;
+	}
+	TLGETC engine(board_size);
+	// A file to keep the tactical hash table in, shared with other runs, can follow the board size
+	if(argc>2 && !engine.hash.open_file(argv[2]))
+	{
+		cout << "Could not use "<<argv[2]<<" for the hash table (it may be for another board size); keeping it in memory\n";
+	}
 	engine.b.display();
 	string command;
 